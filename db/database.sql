@@ -16,6 +16,8 @@ CREATE TABLE [Exif] (
   [Latitude] FLOAT  NULL,                          
   [Longitude] FLOAT  NULL,                         
   [Altitude] FLOAT  NULL,                          
+  [Raw] BLOB  NULL,                                
+  [Duration] FLOAT  NULL,                          
   [PhotoId] INTEGER  NOT NULL                      
 );
 
@@ -24,7 +26,11 @@ CREATE TABLE [Photos] (
   [Name] VARCHAR(32)  UNIQUE NOT NULL,             
   [Hash] VARCHAR(32)  NOT NULL,                    
   [Size] INTEGER  NOT NULL,                        
-  [Date] TIMESTAMP  NOT NULL                       
+  [Date] TIMESTAMP  NOT NULL,                      
+  [Status] INTEGER DEFAULT 0 NOT NULL,             
+  [Path] VARCHAR(1024)  NULL,                      
+  [ObjectId] INTEGER  NULL,                        
+  [Refs] INTEGER DEFAULT 0 NOT NULL                
 );
 
 CREATE TABLE [Tags] (                              
@@ -32,3 +38,47 @@ CREATE TABLE [Tags] (
   [Name] VARCHAR(1024)  NOT NULL,                  
   [PhotoId] INTEGER  NOT NULL                      
 );
+
+CREATE TABLE [ChangeLog] (                         
+  [Seq] INTEGER  PRIMARY KEY AUTOINCREMENT NOT NULL,
+  [PhotoId] INTEGER  NOT NULL                      
+);
+
+CREATE TABLE [Views] (                             
+  [Name] VARCHAR(32)  PRIMARY KEY NOT NULL,        
+  [Watermark] INTEGER  NOT NULL,                   
+  [LinkType] VARCHAR(16) DEFAULT 'symlink' NOT NULL
+);
+
+CREATE TABLE [Settings] (                          
+  [Name] VARCHAR(32)  PRIMARY KEY NOT NULL,        
+  [Value] VARCHAR(1024)  NULL                      
+);
+
+INSERT INTO [Settings] (Name,Value) VALUES ('BulkLayout','flat');
+
+CREATE TRIGGER [PhotosInsert] AFTER INSERT ON [Photos] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.Id); END;
+CREATE TRIGGER [PhotosUpdate] AFTER UPDATE ON [Photos] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.Id); END;
+CREATE TRIGGER [PhotosDelete] AFTER DELETE ON [Photos] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (OLD.Id); END;
+
+CREATE TRIGGER [PhotosRefsInsert] AFTER INSERT ON [Photos] WHEN NEW.ObjectId IS NOT NULL BEGIN UPDATE Photos SET Refs = Refs + 1 WHERE Id = NEW.ObjectId; END;
+CREATE TRIGGER [PhotosRefsDelete] AFTER DELETE ON [Photos] WHEN OLD.ObjectId IS NOT NULL BEGIN UPDATE Photos SET Refs = Refs - 1 WHERE Id = OLD.ObjectId; END;
+CREATE TRIGGER [PhotosRefsShared] BEFORE DELETE ON [Photos] WHEN OLD.Refs > 0 BEGIN SELECT RAISE(ABORT, 'photo file is shared'); END;
+CREATE TRIGGER [PhotosRefsMove] AFTER UPDATE OF Path ON [Photos] WHEN NEW.Refs > 0 BEGIN INSERT INTO ChangeLog (PhotoId) SELECT Id FROM Photos WHERE ObjectId = NEW.Id; END;
+CREATE INDEX [PhotosObjectId] ON [Photos] (ObjectId);
+CREATE INDEX [PhotosHash] ON [Photos] (Hash);
+
+CREATE TRIGGER [TagsInsert] AFTER INSERT ON [Tags] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.PhotoId); END;
+CREATE TRIGGER [TagsUpdate] AFTER UPDATE ON [Tags] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.PhotoId); END;
+CREATE TRIGGER [TagsDelete] AFTER DELETE ON [Tags] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (OLD.PhotoId); END;
+CREATE INDEX [TagsPhotoId] ON [Tags] (PhotoId);
+
+CREATE TRIGGER [AlbumsInsert] AFTER INSERT ON [Albums] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.PhotoId); END;
+CREATE TRIGGER [AlbumsUpdate] AFTER UPDATE ON [Albums] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.PhotoId); END;
+CREATE TRIGGER [AlbumsDelete] AFTER DELETE ON [Albums] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (OLD.PhotoId); END;
+CREATE INDEX [AlbumsPhotoId] ON [Albums] (PhotoId);
+
+CREATE TRIGGER [ExifInsert] AFTER INSERT ON [Exif] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.PhotoId); END;
+CREATE TRIGGER [ExifUpdate] AFTER UPDATE ON [Exif] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.PhotoId); END;
+CREATE TRIGGER [ExifDelete] AFTER DELETE ON [Exif] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (OLD.PhotoId); END;
+CREATE INDEX [ExifPhotoId] ON [Exif] (PhotoId);
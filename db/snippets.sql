@@ -7,3 +7,20 @@ DELETE FROM Tags WHERE Name LIKE '20%';
 /* reorder index */
 UPDATE Tags SET Id = (SELECT COUNT(*) FROM Tags t WHERE t.Id <= Tags.Id);
 UPDATE Albums SET Id = (SELECT COUNT(*) FROM Albums t WHERE t.Id <= Albums.Id);
+
+/* extract EXIF fields from the raw blocks (sqlite3 shell, exif_tag extension) */
+.load libqtphotodb_exifsql
+
+/* backfill a new column without reading the bulk files */
+ALTER TABLE Exif ADD COLUMN [LensModel] VARCHAR(1024) NULL;
+UPDATE Exif SET LensModel = exif_tag(Raw, 0xA434) WHERE Raw IS NOT NULL;
+
+/* index on a field which has no column (0x8827: ISO speed) */
+CREATE INDEX [ExifISO] ON Exif (exif_tag(Raw, 0x8827));
+SELECT PhotoId FROM Exif WHERE exif_tag(Raw, 0x8827) >= 3200;
+
+/* values of multi-valued tags (0xA432: lens info, 4 rationals) */
+SELECT exif_tag(Raw, 0xA432, 0), exif_tag(Raw, 0xA432, 1) FROM Exif;
+
+/* photos which failed the structural check on import (1: truncated, 2: corrupt) */
+SELECT Name, Status FROM Photos WHERE Status <> 0;
@@ -0,0 +1,335 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "defines.h"
+#include "options.h"
+#include "../qtphotodb_bench_import/corpus.h"
+#include "../qtphotodb_import/exif.h"
+
+#include <new>
+#include <stdlib.h>
+
+QTextStream cout(stdout, QIODevice::WriteOnly);
+QTextStream cerr(stderr, QIODevice::WriteOnly);
+
+// every allocation of the process is counted, the benchmark only looks at
+// the difference around the parser calls
+static QAtomicInteger<quint64> allocations(0);
+
+void *operator new(size_t size)
+{
+  allocations.fetchAndAddRelaxed(1);
+  void *p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
+
+struct Sample
+{
+  QString category;
+  QString name;
+  QByteArray data;
+};
+
+struct Measure
+{
+  int code;
+  double nsPerParse;
+  double allocsPerParse;
+  unsigned minPrefix;      // shortest prefix giving the same result
+};
+
+QList<Sample> syntheticCorpus(int dataSize);
+QList<Sample> fileCorpus(const QString &corpusPath);
+Measure measure(const Sample &sample, qint64 minTimeNs);
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  Options options;
+
+  bool noLogo = false;
+  QString corpusPath;
+  QString resultPath;
+  QString size = "2048";
+  QString time = "20";
+
+  // set the application info
+  app.setApplicationName(APP_NAME);
+  app.setOrganizationName(APP_COMPANY);
+  app.setOrganizationDomain(APP_DOMAIN);
+  app.setApplicationVersion(APP_VERSION);
+
+  // add the application options
+  options.add(&corpusPath, "corpusPath", "-corpus", "directory with real jpeg files",              false);
+  options.add(&size,       "kB",         "-size"  , "image data size of the synthetic files (kB)", false);
+  options.add(&time,       "ms",         "-time"  , "minimum measurement time per file (ms)",      false);
+  options.add(&resultPath, "resultFile", "-o"     , "json result file",                            false);
+  options.add(&noLogo,     "",           "-nologo", "do not show logo",                            false);
+
+  // set the application options values
+  if (!options.set())
+  {
+    cout << options.logo()  << endl;
+    cout << options.usage() << endl;
+    return 1;
+  }
+  else if (!noLogo)
+  {
+    // print copyright logo
+    cout << options.logo() << endl;
+  }
+
+  QList<Sample> samples = syntheticCorpus(size.toInt() * 1024);
+  if (!corpusPath.isEmpty())
+  {
+    samples += fileCorpus(corpusPath);
+  }
+
+  cout << QString("%1 %2 %3 %4 %5 %6  %7")
+          .arg("category", -16).arg("code", 5).arg("size", 10).arg("ns/file", 12)
+          .arg("allocs", 8).arg("min prefix", 10).arg("file") << endl;
+
+  QJsonArray results;
+  QMap<QString, QList<Measure> > categories;
+  for (int i = 0; i < samples.count(); i++)
+  {
+    const Sample &sample = samples[i];
+    Measure m = measure(sample, time.toLongLong() * 1000000);
+    categories[sample.category].append(m);
+
+    cout << QString("%1 %2 %3 %4 %5 %6  %7")
+            .arg(sample.category,   -16)
+            .arg(m.code,              5)
+            .arg(sample.data.size(), 10)
+            .arg(m.nsPerParse,       12, 'f', 0)
+            .arg(m.allocsPerParse,    8, 'f', 1)
+            .arg(m.minPrefix,        10)
+            .arg(sample.name) << endl;
+
+    QJsonObject result;
+    result["benchmark"]      = QString("exif");
+    result["category"]       = sample.category;
+    result["file"]           = sample.name;
+    result["size"]           = sample.data.size();
+    result["code"]           = m.code;
+    result["ns_per_parse"]   = m.nsPerParse;
+    result["allocs_per_parse"] = m.allocsPerParse;
+    result["min_prefix_bytes"] = qint64(m.minPrefix);
+    results.append(result);
+  }
+
+  // summary per category
+  cout << endl;
+  QMapIterator<QString, QList<Measure> > it(categories);
+  while (it.hasNext())
+  {
+    it.next();
+    double ns = 0, allocs = 0, bytes = 0;
+    for (int i = 0; i < it.value().count(); i++)
+    {
+      ns     += it.value()[i].nsPerParse;
+      allocs += it.value()[i].allocsPerParse;
+      bytes  += it.value()[i].minPrefix;
+    }
+    int n = it.value().count();
+    cout << QString("%1 %2 files, %3 ns/file, %4 allocs/parse, %5 bytes min prefix")
+            .arg(it.key(), -16).arg(n, 5)
+            .arg(ns / n, 0, 'f', 0).arg(allocs / n, 0, 'f', 1).arg(bytes / n, 0, 'f', 0) << endl;
+  }
+
+  if (!resultPath.isEmpty())
+  {
+    QSaveFile resultFile(resultPath);
+    if (!resultFile.open(QIODevice::WriteOnly))
+    {
+      cerr << "ERROR: File " << resultPath << " cannot be written!" << endl;
+      return 1;
+    }
+    resultFile.write(QJsonDocument(results).toJson());
+    resultFile.commit();
+  }
+
+  return 0;
+}
+
+QList<Sample> syntheticCorpus(int dataSize)
+{
+  QList<Sample> samples;
+
+  // byte order x GPS
+  for (int order = 0; order < 2; order++)
+  {
+    for (int gps = 0; gps < 2; gps++)
+    {
+      JpegSpec spec;
+      spec.intel     = (order == 0);
+      spec.make      = "Generic";
+      spec.model     = "Camera";
+      spec.dateTime  = "2014:07:12 10:20:30";
+      spec.width     = 4000;
+      spec.height    = 3000;
+      spec.gps       = gps;
+      spec.latitude  = 47.3769;
+      spec.longitude = 8.5417;
+      spec.altitude  = 408;
+      spec.dataSize  = dataSize;
+
+      Sample sample;
+      sample.category = QString("%1-%2").arg(spec.intel ? "intel" : "motorola").arg(spec.gps ? "gps" : "nogps");
+      sample.name     = sample.category + ".jpg";
+      sample.data     = createJpeg(spec);
+      samples.append(sample);
+    }
+  }
+
+  // maker note heavy files close to the 64k limit of the APP1 segment
+  JpegSpec canon;
+  canon.intel         = true;
+  canon.make          = "Canon";
+  canon.model         = "Canon EOS 5D Mark III";
+  canon.dateTime      = "2015:01:02 03:04:05";
+  canon.gps           = false;
+  canon.makerNoteSize = 60000;
+  canon.dataSize      = dataSize;
+
+  JpegSpec nikon      = canon;
+  nikon.intel         = false;
+  nikon.make          = "NIKON CORPORATION";
+  nikon.model         = "NIKON D750";
+  nikon.gps           = true;
+  nikon.latitude      = -33.8568;
+  nikon.longitude     = 151.2153;
+
+  Sample sample;
+  sample.category = "canon-makernote";
+  sample.name     = "canon.jpg";
+  sample.data     = createJpeg(canon);
+  samples.append(sample);
+
+  sample.category = "nikon-makernote";
+  sample.name     = "nikon.jpg";
+  sample.data     = createJpeg(nikon);
+  samples.append(sample);
+
+  // padded trailer after the end of image marker
+  JpegSpec padded     = canon;
+  padded.makerNoteSize = 0;
+  padded.paddingSize  = 256 * 1024;
+  sample.category = "padded-trailer";
+  sample.name     = "padded.jpg";
+  sample.data     = createJpeg(padded);
+  samples.append(sample);
+
+  return samples;
+}
+
+QList<Sample> fileCorpus(const QString &corpusPath)
+{
+  QList<Sample> samples;
+  QStringList filter;
+  filter << "*.jpg" << "*.jpeg";
+
+  QDirIterator it(corpusPath, filter, QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext())
+  {
+    QFile file(it.next());
+    if (!file.open(QIODevice::ReadOnly)) continue;
+
+    Sample sample;
+    sample.category = "real";
+    sample.name     = it.filePath();
+    sample.data     = file.readAll();
+    samples.append(sample);
+  }
+
+  return samples;
+}
+
+Measure measure(const Sample &sample, qint64 minTimeNs)
+{
+  const unsigned char *data = reinterpret_cast<const unsigned char*>(sample.data.constData());
+  unsigned length = sample.data.size();
+  easyexif::EXIFInfo info;
+  Measure m;
+
+  // warm up, the EXIFInfo object is reused like in a real import loop
+  m.code = info.parseFrom(data, length);
+
+  // repeat until the minimum measurement time is reached
+  QElapsedTimer timer;
+  qint64 parses = 0, elapsed = 0;
+  quint64 allocs = allocations.load();
+  timer.start();
+  do
+  {
+    for (int i = 0; i < 16; i++)
+    {
+      info.parseFrom(data, length);
+    }
+    parses += 16;
+    elapsed = timer.nsecsElapsed();
+  } while (elapsed < minTimeNs);
+  m.nsPerParse     = double(elapsed) / parses;
+  m.allocsPerParse = double(allocations.load() - allocs) / parses;
+
+  // smallest prefix of the file which gives the same result, found by a
+  // binary search; this is the least the import has to read (assuming a
+  // longer prefix never gives a worse result), not the number of bytes the
+  // parser actually touches
+  unsigned low = 0, high = length;
+  easyexif::EXIFInfo reference;
+  reference.parseFrom(data, length);
+  while (low < high)
+  {
+    unsigned middle = low + (high - low) / 2;
+    easyexif::EXIFInfo prefix;
+    int code = prefix.parseFrom(data, middle);
+    if (code == m.code && prefix.Make == reference.Make && prefix.DateTime == reference.DateTime &&
+        prefix.ImageWidth == reference.ImageWidth && prefix.GeoLocation.Latitude == reference.GeoLocation.Latitude)
+    {
+      high = middle;
+    }
+    else
+    {
+      low = middle + 1;
+    }
+  }
+  m.minPrefix = high;
+
+  return m;
+}
@@ -0,0 +1,23 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include <QtCore>
+
@@ -0,0 +1,444 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "corpus.h"
+
+#include <math.h>
+
+namespace {
+
+struct Camera
+{
+  const char *make;
+  const char *model;
+  bool intel;
+  int makerNoteSize;
+};
+
+// a few typical cameras, the maker note sizes are in the range of real files
+const Camera cameras[] =
+{
+  { "Canon",             "Canon EOS 5D Mark III", true,   8000 },
+  { "NIKON CORPORATION", "NIKON D750",            false, 20000 },
+  { "Apple",             "iPhone 6",              false,  1500 },
+  { "SONY",              "ILCE-7",                true,  30000 },
+  { "samsung",           "SM-G900F",              true,      0 }
+};
+
+const quint32 resolutions[][2] =
+{
+  { 5760, 3840 }, { 6016, 4016 }, { 3264, 2448 }, { 6000, 4000 }, { 5312, 2988 }
+};
+
+const char *places[] = { "holiday", "alps", "family", "birthday", "berlin", "garden", "wedding", "hike" };
+const char *labels[] = { "anna", "max", "mountain", "lake", "snow", "beach", "party", "city", "night", "friends" };
+
+struct TiffEntry
+{
+  quint16 tag, type;
+  quint32 count;
+  QByteArray value;
+};
+
+class TiffWriter
+{
+  public:
+    TiffWriter(bool intel) : intel(intel) {}
+
+    QByteArray u16(quint16 value) const
+    {
+      QByteArray data(2, '\0');
+      if (intel) { data[0] = value & 0xFF; data[1] = value >> 8; }
+      else       { data[1] = value & 0xFF; data[0] = value >> 8; }
+      return data;
+    }
+
+    QByteArray u32(quint32 value) const
+    {
+      return intel ? (u16(value & 0xFFFF) + u16(value >> 16)) : (u16(value >> 16) + u16(value & 0xFFFF));
+    }
+
+    void add(QList<TiffEntry> &ifd, quint16 tag, quint16 type, quint32 count, const QByteArray &value) const
+    {
+      TiffEntry entry;
+      entry.tag   = tag;
+      entry.type  = type;
+      entry.count = count;
+      entry.value = value;
+      ifd.append(entry);
+    }
+
+    void ascii(QList<TiffEntry> &ifd, quint16 tag, const QByteArray &text) const
+    {
+      add(ifd, tag, 2, text.size() + 1, text + '\0');
+    }
+
+    void shortValue(QList<TiffEntry> &ifd, quint16 tag, quint16 value) const
+    {
+      add(ifd, tag, 3, 1, u16(value));
+    }
+
+    void longValue(QList<TiffEntry> &ifd, quint16 tag, quint32 value) const
+    {
+      add(ifd, tag, 4, 1, u32(value));
+    }
+
+    void rationals(QList<TiffEntry> &ifd, quint16 tag, const QList<double> &values) const
+    {
+      QByteArray data;
+      for (int i = 0; i < values.count(); i++)
+      {
+        data += u32(quint32(values[i] * 1000 + 0.5));
+        data += u32(1000);
+      }
+      add(ifd, tag, 5, values.count(), data);
+    }
+
+    void setLong(QList<TiffEntry> &ifd, quint16 tag, quint32 value) const
+    {
+      for (int i = 0; i < ifd.count(); i++)
+      {
+        if (ifd[i].tag == tag) ifd[i].value = u32(value);
+      }
+    }
+
+    static int size(const QList<TiffEntry> &ifd)
+    {
+      int size = 2 + 12 * ifd.count() + 4;
+      for (int i = 0; i < ifd.count(); i++)
+      {
+        if (ifd[i].value.size() > 4) size += (ifd[i].value.size() + 1) & ~1;
+      }
+      return size;
+    }
+
+    QByteArray write(const QList<TiffEntry> &ifd, quint32 offset) const
+    {
+      QByteArray table, data;
+      quint32 dataOffset = offset + 2 + 12 * ifd.count() + 4;
+
+      table += u16(ifd.count());
+      for (int i = 0; i < ifd.count(); i++)
+      {
+        const TiffEntry &entry = ifd[i];
+        table += u16(entry.tag) + u16(entry.type) + u32(entry.count);
+        if (entry.value.size() <= 4)
+        {
+          // small values are stored left aligned in the offset field
+          table += entry.value + QByteArray(4 - entry.value.size(), '\0');
+        }
+        else
+        {
+          table += u32(dataOffset + data.size());
+          data  += entry.value;
+          if (data.size() & 1) data += '\0';
+        }
+      }
+      table += u32(0);
+
+      return table + data;
+    }
+
+  private:
+    bool intel;
+};
+
+QByteArray segment(quint8 marker, const QByteArray &payload)
+{
+  QByteArray data;
+  data += char(0xFF);
+  data += char(marker);
+  data += char((payload.size() + 2) >> 8);
+  data += char((payload.size() + 2) & 0xFF);
+  return data + payload;
+}
+
+}
+
+Random::Random(quint64 seed)
+{
+  state = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+}
+
+quint32 Random::next()
+{
+  // xorshift64*
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return quint32((state * 2685821657736338717ULL) >> 32);
+}
+
+quint32 Random::next(quint32 max)
+{
+  return max ? next() % max : 0;
+}
+
+double Random::uniform()
+{
+  return next() / 4294967296.0;
+}
+
+JpegSpec::JpegSpec()
+{
+  intel         = true;
+  width         = 640;
+  height        = 480;
+  gps           = false;
+  latitude      = longitude = altitude = 0;
+  makerNoteSize = 0;
+  dataSize      = 4096;
+  paddingSize   = 0;
+  seed          = 1;
+}
+
+QByteArray createTiffBlock(const JpegSpec &spec)
+{
+  TiffWriter tiff(spec.intel);
+  QList<TiffEntry> ifd0, exif, gps;
+
+  // IFD0 - main image
+  tiff.ascii(ifd0, 0x010F, spec.make);
+  tiff.ascii(ifd0, 0x0110, spec.model);
+  tiff.shortValue(ifd0, 0x0112, 1);
+  tiff.ascii(ifd0, 0x0131, "qtphotodb_bench");
+  tiff.ascii(ifd0, 0x0132, spec.dateTime);
+  tiff.longValue(ifd0, 0x8769, 0);
+  if (spec.gps) tiff.longValue(ifd0, 0x8825, 0);
+
+  // EXIF SubIFD
+  QList<double> exposure; exposure << 0.008;
+  QList<double> fnumber;  fnumber  << 4.0;
+  tiff.rationals(exif, 0x829A, exposure);
+  tiff.rationals(exif, 0x829D, fnumber);
+  tiff.shortValue(exif, 0x8827, 200);
+  tiff.ascii(exif, 0x9003, spec.dateTime);
+  tiff.ascii(exif, 0x9004, spec.dateTime);
+  if (spec.makerNoteSize > 0)
+  {
+    QByteArray note(spec.makerNoteSize, '\0');
+    Random random(spec.seed);
+    for (int i = 0; i < note.size(); i++) note[i] = char(random.next());
+    tiff.add(exif, 0x927C, 7, note.size(), note);
+  }
+  tiff.longValue(exif, 0xA002, spec.width);
+  tiff.longValue(exif, 0xA003, spec.height);
+
+  // GPS SubIFD
+  if (spec.gps)
+  {
+    double lat = fabs(spec.latitude), lon = fabs(spec.longitude);
+    QList<double> latitude, longitude, altitude;
+    latitude  << floor(lat) << floor(fmod(lat * 60, 60)) << fmod(lat * 3600, 60);
+    longitude << floor(lon) << floor(fmod(lon * 60, 60)) << fmod(lon * 3600, 60);
+    altitude  << fabs(spec.altitude);
+
+    tiff.add(gps, 0x0000, 1, 4, QByteArray("\x02\x02\x00\x00", 4));
+    tiff.ascii(gps, 0x0001, spec.latitude  < 0 ? "S" : "N");
+    tiff.rationals(gps, 0x0002, latitude);
+    tiff.ascii(gps, 0x0003, spec.longitude < 0 ? "W" : "E");
+    tiff.rationals(gps, 0x0004, longitude);
+    tiff.add(gps, 0x0005, 1, 1, QByteArray(1, spec.altitude < 0 ? 1 : 0));
+    tiff.rationals(gps, 0x0006, altitude);
+  }
+
+  // layout: header, IFD0, EXIF SubIFD, GPS SubIFD (each followed by its data)
+  quint32 ifd0Offset = 8;
+  quint32 exifOffset = ifd0Offset + TiffWriter::size(ifd0);
+  quint32 gpsOffset  = exifOffset + TiffWriter::size(exif);
+  tiff.setLong(ifd0, 0x8769, exifOffset);
+  tiff.setLong(ifd0, 0x8825, gpsOffset);
+
+  QByteArray block(spec.intel ? "II" : "MM");
+  block += tiff.u16(0x2A);
+  block += tiff.u32(ifd0Offset);
+  block += tiff.write(ifd0, ifd0Offset);
+  block += tiff.write(exif, exifOffset);
+  if (spec.gps) block += tiff.write(gps, gpsOffset);
+
+  return block;
+}
+
+QByteArray createJpeg(const JpegSpec &spec)
+{
+  Random random(spec.seed);
+  QByteArray jpeg;
+
+  // start of image
+  jpeg += char(0xFF);
+  jpeg += char(0xD8);
+
+  // APP1 - EXIF
+  jpeg += segment(0xE1, QByteArray("Exif\0\0", 6) + createTiffBlock(spec));
+
+  // DQT - one quantization table
+  QByteArray dqt(65, char(1));
+  dqt[0] = 0;
+  jpeg += segment(0xDB, dqt);
+
+  // SOF0 - baseline, 3 components
+  QByteArray sof;
+  sof += char(8);
+  sof += char(spec.height >> 8); sof += char(spec.height & 0xFF);
+  sof += char(spec.width  >> 8); sof += char(spec.width  & 0xFF);
+  sof += char(3);
+  sof += QByteArray("\x01\x22\x00\x02\x11\x01\x03\x11\x01", 9);
+  jpeg += segment(0xC0, sof);
+
+  // DHT - standard luminance DC table
+  jpeg += segment(0xC4, QByteArray("\x00\x00\x01\x05\x01\x01\x01\x01\x01\x01\x00\x00\x00\x00\x00\x00\x00"
+                                   "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0A\x0B", 29));
+
+  // SOS followed by the entropy coded data (0xFF bytes are stuffed)
+  jpeg += segment(0xDA, QByteArray("\x03\x01\x00\x02\x11\x03\x11\x00\x3F\x00", 10));
+  QByteArray data;
+  data.reserve(spec.dataSize + spec.dataSize / 128);
+  for (int i = 0; i < spec.dataSize; i++)
+  {
+    char value = char(random.next());
+    data += value;
+    if (value == char(0xFF)) data += '\0';
+  }
+  jpeg += data;
+
+  // end of image and optional padding
+  jpeg += char(0xFF);
+  jpeg += char(0xD9);
+  jpeg += QByteArray(spec.paddingSize, '\0');
+
+  return jpeg;
+}
+
+Corpus::Corpus(quint32 seed) : random(seed)
+{
+  fileCount = byteCount = dupeCount = 0;
+}
+
+JpegSpec Corpus::randomSpec(int meanSize)
+{
+  JpegSpec spec;
+
+  const Camera &camera = cameras[random.next(sizeof(cameras) / sizeof(cameras[0]))];
+  spec.intel         = camera.intel;
+  spec.make          = camera.make;
+  spec.model         = camera.model;
+  spec.makerNoteSize = camera.makerNoteSize;
+
+  QDateTime date(QDate(2005 + random.next(11), 1 + random.next(12), 1 + random.next(28)),
+                 QTime(random.next(24), random.next(60), random.next(60)));
+  spec.dateTime = date.toString("yyyy:MM:dd hh:mm:ss").toLatin1();
+
+  const quint32 *resolution = resolutions[random.next(sizeof(resolutions) / sizeof(resolutions[0]))];
+  bool portrait = random.uniform() < 0.2;
+  spec.width  = resolution[portrait ? 1 : 0];
+  spec.height = resolution[portrait ? 0 : 1];
+
+  spec.gps = random.uniform() < 0.6;
+  if (spec.gps)
+  {
+    spec.latitude  = random.uniform() * 180 - 90;
+    spec.longitude = random.uniform() * 360 - 180;
+    spec.altitude  = random.uniform() * 3000 - 100;
+  }
+
+  // log-normal size distribution around the mean size
+  double u1 = qMax(random.uniform(), 1e-9), u2 = random.uniform();
+  double normal = sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+  spec.dataSize = qMax(1024, int(meanSize * exp(0.5 * normal - 0.125)));
+
+  // some cameras pad the file after the end of image marker
+  spec.paddingSize = (random.uniform() < 0.1) ? int(random.next(4096)) : 0;
+  spec.seed = random.next();
+
+  return spec;
+}
+
+QString Corpus::randomFolder()
+{
+  // album/tag-tag layout as used for imports
+  int place = random.next(sizeof(places) / sizeof(places[0]));
+  int label1 = random.next(sizeof(labels) / sizeof(labels[0]));
+  int label2 = random.next(sizeof(labels) / sizeof(labels[0]));
+
+  return QString("%1-%2/%3-%4").arg(2005 + random.next(11)).arg(places[place]).arg(labels[label1]).arg(labels[label2]);
+}
+
+bool Corpus::generate(const QString &path, int count, double dupeRatio, int meanSize)
+{
+  QDir root(path);
+  QStringList written;
+
+  for (int i = 0; i < count; i++)
+  {
+    QString folder = randomFolder();
+    QString filePath = QString("%1/%2/IMG_%3.JPG").arg(root.path()).arg(folder).arg(i, 6, 10, QChar('0'));
+    root.mkpath(folder);
+
+    // byte identical copy with the same modification time (a real dupe)
+    if (!written.isEmpty() && random.uniform() < dupeRatio)
+    {
+      QString sourcePath = written[random.next(written.count())];
+      if (!QFile::copy(sourcePath, filePath)) return false;
+
+      QFile file(filePath);
+      if (!file.open(QIODevice::ReadWrite)) return false;
+      file.setFileTime(QFileInfo(sourcePath).lastModified(), QFileDevice::FileModificationTime);
+      byteCount += file.size();
+      file.close();
+
+      dupeCount++;
+      fileCount++;
+      continue;
+    }
+
+    JpegSpec spec = randomSpec(meanSize);
+    QByteArray jpeg = createJpeg(spec);
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    if (file.write(jpeg) != jpeg.size()) return false;
+    file.flush();
+    file.setFileTime(QDateTime::fromString(QString(spec.dateTime), "yyyy:MM:dd hh:mm:ss"), QFileDevice::FileModificationTime);
+    file.close();
+
+    written.append(filePath);
+    byteCount += jpeg.size();
+    fileCount++;
+  }
+
+  return true;
+}
+
+qint64 Corpus::files() const
+{
+  return fileCount;
+}
+
+qint64 Corpus::bytes() const
+{
+  return byteCount;
+}
+
+qint64 Corpus::dupes() const
+{
+  return dupeCount;
+}
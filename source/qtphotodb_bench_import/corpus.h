@@ -0,0 +1,79 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+// small deterministic generator, the corpus must be the same on every machine
+class Random
+{
+  public:
+    Random(quint64 seed);
+
+    quint32 next();
+    quint32 next(quint32 max);
+    double uniform();
+
+  private:
+    quint64 state;
+};
+
+struct JpegSpec
+{
+  JpegSpec();
+
+  bool intel;                 // byte order of the TIFF block
+  QByteArray make;
+  QByteArray model;
+  QByteArray dateTime;        // "YYYY:MM:DD HH:MM:SS"
+  quint32 width, height;
+  bool gps;
+  double latitude, longitude, altitude;
+  int makerNoteSize;          // size of the (opaque) maker note in the EXIF SubIFD
+  int dataSize;               // size of the entropy coded data
+  int paddingSize;            // null bytes after the end of image marker
+  quint32 seed;               // seed for the entropy coded data
+};
+
+QByteArray createTiffBlock(const JpegSpec &spec);
+QByteArray createJpeg(const JpegSpec &spec);
+
+class Corpus
+{
+  public:
+    Corpus(quint32 seed);
+
+    bool generate(const QString &path, int count, double dupeRatio, int meanSize);
+
+    qint64 files() const;
+    qint64 bytes() const;
+    qint64 dupes() const;
+
+  private:
+    JpegSpec randomSpec(int meanSize);
+    QString randomFolder();
+
+  private:
+    Random random;
+    qint64 fileCount, byteCount, dupeCount;
+};
+
+#endif // CORPUS_H
@@ -0,0 +1,207 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "defines.h"
+#include "options.h"
+#include "corpus.h"
+
+QTextStream cout(stdout, QIODevice::WriteOnly);
+QTextStream cerr(stderr, QIODevice::WriteOnly);
+
+bool runTool(const QString &binPath, const QString &tool, const QStringList &arguments, double &seconds);
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  Options options;
+
+  bool noLogo = false;
+  QString workPath;
+  QString binPath = QCoreApplication::applicationDirPath();
+  QString resultPath;
+  QString files = "1000";
+  QString dupes = "0.1";
+  QString size  = "2048";
+  QString seed  = "1";
+  QString modes = "fresh,prescan,reimport";
+
+  // set the application info
+  app.setApplicationName(APP_NAME);
+  app.setOrganizationName(APP_COMPANY);
+  app.setOrganizationDomain(APP_DOMAIN);
+  app.setApplicationVersion(APP_VERSION);
+
+  // add the application options
+  options.add(&workPath,   "workPath",               "directory for the corpus and the archives", true );
+  options.add(&files,      "count",      "-files"  , "number of files in the corpus",             false);
+  options.add(&dupes,      "ratio",      "-dupes"  , "ratio of duplicated files (0..1)",          false);
+  options.add(&size,       "kB",         "-size"   , "mean size of the files in kB",              false);
+  options.add(&seed,       "seed",       "-seed"   , "seed of the corpus generator",              false);
+  options.add(&modes,      "modes",      "-modes"  , "import modes (fresh, prescan, reimport)",   false);
+  options.add(&binPath,    "binPath",    "-bin"    , "directory of the qtphotodb tools",          false);
+  options.add(&resultPath, "resultFile", "-o"      , "json result file",                          false);
+  options.add(&noLogo,     "",           "-nologo" , "do not show logo",                          false);
+
+  // set the application options values
+  if (!options.set())
+  {
+    cout << options.logo()  << endl;
+    cout << options.usage() << endl;
+    return 1;
+  }
+  else if (!noLogo)
+  {
+    // print copyright logo
+    cout << options.logo() << endl;
+  }
+
+  // prepare the work directory
+  QDir workDir(workPath);
+  if (!workDir.mkpath("."))
+  {
+    cerr << "ERROR: Directory " << workPath << " cannot be created!" << endl;
+    return 1;
+  }
+  workPath = workDir.absolutePath();
+  if (resultPath.isEmpty()) resultPath = workPath + "/results.json";
+
+  // the corpus is generated once per parameter set and reused afterwards
+  QString corpusName = QString("corpus-%1-%2-%3-%4").arg(files).arg(dupes).arg(size).arg(seed);
+  QString corpusPath = workPath + "/" + corpusName;
+  qint64 corpusFiles = 0, corpusBytes = 0;
+  if (!QFileInfo::exists(corpusPath))
+  {
+    cout << "Generating corpus " << corpusName; cout.flush();
+    Corpus corpus(seed.toUInt());
+    if (!corpus.generate(corpusPath + ".tmp", files.toInt(), dupes.toDouble(), size.toInt() * 1024) ||
+        !QDir().rename(corpusPath + ".tmp", corpusPath))
+    {
+      cerr << endl << "ERROR: Corpus " << corpusPath << " cannot be generated!" << endl;
+      return 1;
+    }
+    cout << "..." << corpus.files() << " files, " << corpus.dupes() << " dupes, " << corpus.bytes() / 1048576 << " MB" << endl;
+  }
+  QDirIterator it(corpusPath, QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext())
+  {
+    it.next();
+    corpusFiles++;
+    corpusBytes += it.fileInfo().size();
+  }
+
+  // run the import in all requested modes against a fresh archive
+  QJsonArray results;
+  QStringList modeList = modes.split(',', QString::SkipEmptyParts);
+  for (int i = 0; i < modeList.count(); i++)
+  {
+    QString mode = modeList[i];
+    QString archivePath = workPath + "/archive-" + mode;
+    double seconds = 0;
+
+    cout << "Running " << mode; cout.flush();
+    QDir(archivePath).removeRecursively();
+    QDir().mkpath(archivePath);
+    if (!runTool(binPath, "qtphotodb_create", QStringList() << archivePath << "-nologo", seconds))
+    {
+      return 2;
+    }
+
+    QStringList arguments;
+    arguments << archivePath << "-i" << corpusPath << "-nologo";
+    if (mode == "fresh")
+    {
+      if (!runTool(binPath, "qtphotodb_import", arguments, seconds)) return 2;
+    }
+    else if (mode == "prescan")
+    {
+      if (!runTool(binPath, "qtphotodb_import", arguments << "-prescan", seconds)) return 2;
+    }
+    else if (mode == "reimport")
+    {
+      // the second import finds only dupes
+      if (!runTool(binPath, "qtphotodb_import", arguments, seconds)) return 2;
+      if (!runTool(binPath, "qtphotodb_import", arguments, seconds)) return 2;
+    }
+    else
+    {
+      cerr << "ERROR: Unknown mode " << mode << "!" << endl;
+      return 1;
+    }
+
+    QJsonObject result;
+    result["benchmark"]   = QString("import");
+    result["mode"]        = mode;
+    result["corpus"]      = corpusName;
+    result["files"]       = corpusFiles;
+    result["bytes"]       = corpusBytes;
+    result["seconds"]     = seconds;
+    result["files_per_s"] = corpusFiles / seconds;
+    result["mb_per_s"]    = corpusBytes / 1048576.0 / seconds;
+    result["db_size"]     = QFileInfo(archivePath + "/database.s3db").size();
+    result["timestamp"]   = QDateTime::currentDateTime().toString(Qt::ISODate);
+    results.append(result);
+
+    cout << "..." << QString("%1 s, %2 files/s, %3 MB/s, db %4 kB")
+                     .arg(seconds, 0, 'f', 2)
+                     .arg(corpusFiles / seconds, 0, 'f', 1)
+                     .arg(corpusBytes / 1048576.0 / seconds, 0, 'f', 1)
+                     .arg(QFileInfo(archivePath + "/database.s3db").size() / 1024) << endl;
+  }
+
+  // write the machine readable results
+  QSaveFile resultFile(resultPath);
+  if (!resultFile.open(QIODevice::WriteOnly))
+  {
+    cerr << "ERROR: File " << resultPath << " cannot be written!" << endl;
+    return 1;
+  }
+  resultFile.write(QJsonDocument(results).toJson());
+  resultFile.commit();
+  cout << "Results written to " << resultPath << endl;
+
+  return 0;
+}
+
+bool runTool(const QString &binPath, const QString &tool, const QStringList &arguments, double &seconds)
+{
+  QProcess process;
+  process.setStandardOutputFile(QProcess::nullDevice());
+  process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+
+  QElapsedTimer timer;
+  timer.start();
+  process.start(binPath + "/" + tool, arguments);
+  if (!process.waitForStarted() || !process.waitForFinished(-1))
+  {
+    cerr << endl << "ERROR: " << tool << " cannot be started!" << endl;
+    return false;
+  }
+  seconds = qMax<qint64>(timer.elapsed(), 1) / 1000.0;
+
+  if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+  {
+    cerr << endl << "ERROR: " << tool << " failed with code " << process.exitCode() << "!" << endl;
+    return false;
+  }
+
+  return true;
+}
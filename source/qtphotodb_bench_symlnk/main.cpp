@@ -0,0 +1,434 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "defines.h"
+#include "options.h"
+#include "../qtphotodb_bench_import/corpus.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+QTextStream cout(stdout, QIODevice::WriteOnly);
+QTextStream cerr(stderr, QIODevice::WriteOnly);
+
+struct RunStat
+{
+  double seconds;
+  long maxRss;
+  qint64 syscalls;
+  QJsonObject syscallList;
+};
+
+// photos changed before an incremental run (every Nth photo)
+#define INCREMENTAL_STEP 100
+
+bool populate(const QString &archivePath, qint64 photos, quint32 seed);
+bool prepareRun(const QString &archivePath, const QString &viewPath, const QString &run, qint64 &changed);
+bool runTool(const QStringList &command, RunStat &stat);
+bool countSyscalls(const QStringList &command, RunStat &stat);
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  Options options;
+
+  bool noLogo = false;
+  bool strace = false;
+  QString workPath;
+  QString binPath = QCoreApplication::applicationDirPath();
+  QString resultPath;
+  QString photos = "1000000";
+  QString seed   = "1";
+  QString views  = "date,tag,album,size";
+
+  // set the application info
+  app.setApplicationName(APP_NAME);
+  app.setOrganizationName(APP_COMPANY);
+  app.setOrganizationDomain(APP_DOMAIN);
+  app.setApplicationVersion(APP_VERSION);
+
+  // add the application options
+  options.add(&workPath,   "workPath",               "directory for the synthetic archive",         true );
+  options.add(&photos,     "count",      "-photos" , "number of photos in the catalog",             false);
+  options.add(&seed,       "seed",       "-seed"   , "seed of the catalog generator",               false);
+  options.add(&views,      "views",      "-views"  , "views to link (date, tag, album, size)",      false);
+  options.add(&binPath,    "binPath",    "-bin"    , "directory of the qtphotodb tools",            false);
+  options.add(&resultPath, "resultFile", "-o"      , "json result file",                            false);
+  options.add(&strace,     "",           "-strace" , "count syscalls with strace (extra runs)",     false);
+  options.add(&noLogo,     "",           "-nologo" , "do not show logo",                            false);
+
+  // set the application options values
+  if (!options.set())
+  {
+    cout << options.logo()  << endl;
+    cout << options.usage() << endl;
+    return 1;
+  }
+  else if (!noLogo)
+  {
+    // print copyright logo
+    cout << options.logo() << endl;
+  }
+
+  // prepare the work directory
+  QDir workDir(workPath);
+  if (!workDir.mkpath("."))
+  {
+    cerr << "ERROR: Directory " << workPath << " cannot be created!" << endl;
+    return 1;
+  }
+  workPath = workDir.absolutePath();
+  if (resultPath.isEmpty()) resultPath = workPath + "/results.json";
+
+  // the catalog is generated once per parameter set and reused afterwards
+  QString archiveName = QString("catalog-%1-%2").arg(photos).arg(seed);
+  QString archivePath = workPath + "/" + archiveName;
+  if (!QFileInfo::exists(archivePath + "/database.s3db"))
+  {
+    RunStat stat;
+    cout << "Generating catalog " << archiveName; cout.flush();
+    QDir(archivePath).removeRecursively();
+    QDir().mkpath(archivePath);
+    if (!runTool(QStringList() << binPath + "/qtphotodb_create" << archivePath << "-nologo", stat) ||
+        !populate(archivePath, photos.toLongLong(), seed.toUInt()))
+    {
+      cerr << endl << "ERROR: Catalog " << archivePath << " cannot be generated!" << endl;
+      QFile::remove(archivePath + "/database.s3db");
+      return 1;
+    }
+    cout << "done" << endl;
+  }
+
+  // number of links expected per view
+  QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+  db.setDatabaseName(archivePath + "/database.s3db");
+  if (!db.open())
+  {
+    cerr << "ERROR: Database " << archivePath + "/database.s3db" << " cannot be opened!" << endl;
+    return 2;
+  }
+  QMap<QString, qint64> linkCount;
+  QSqlQuery q(db);
+  q.exec("SELECT count(*) FROM Photos");                                                 q.next(); linkCount["date"]  = q.value(0).toLongLong();
+  q.exec("SELECT count(*) FROM Photos INNER JOIN Tags   ON Photos.Id = Tags.PhotoId");   q.next(); linkCount["tag"]   = q.value(0).toLongLong();
+  q.exec("SELECT count(*) FROM Photos INNER JOIN Albums ON Photos.Id = Albums.PhotoId"); q.next(); linkCount["album"] = q.value(0).toLongLong();
+  q.exec("SELECT count(*) FROM Photos INNER JOIN Exif   ON Photos.Id = Exif.PhotoId");   q.next(); linkCount["size"]  = q.value(0).toLongLong();
+  q.finish();
+  db.close();
+
+  // link every view cold (empty view tree) and warm (all links exist), both
+  // with -full as the watermark of the view would skip all photos, then
+  // incremental with a few changed photos since the warm run
+  QJsonArray results;
+  QStringList viewList = views.split(',', QString::SkipEmptyParts);
+  for (int i = 0; i < viewList.count(); i++)
+  {
+    QString view = viewList[i];
+    QString viewPath = archivePath + "/sort/by_" + view;
+
+    QStringList runs;
+    runs << "cold" << "warm" << "incremental";
+    for (int j = 0; j < runs.count(); j++)
+    {
+      RunStat stat;
+      stat.syscalls = -1;
+      qint64 changed = 0;
+
+      QStringList command;
+      command << binPath + "/qtphotodb_symlink" << archivePath << "-link_by" << view << "-nologo";
+      if (runs[j] != "incremental") command << "-full";
+
+      cout << "Linking by " << view << " (" << runs[j] << ")"; cout.flush();
+      if (!prepareRun(archivePath, viewPath, runs[j], changed))
+      {
+        cerr << endl << "ERROR: Catalog " << archivePath << " cannot be prepared!" << endl;
+        return 2;
+      }
+      if (!runTool(command, stat))
+      {
+        cerr << endl << "ERROR: qtphotodb_symlink failed!" << endl;
+        return 2;
+      }
+
+      // strace slows the tool down a lot, so the syscalls come from an extra run
+      if (strace)
+      {
+        if (!prepareRun(archivePath, viewPath, runs[j], changed) ||
+            !countSyscalls(command, stat))
+        {
+          cerr << endl << "ERROR: strace failed!" << endl;
+          return 2;
+        }
+      }
+
+      // an incremental run only looks at the changed photos
+      bool incremental = (runs[j] == "incremental");
+      qint64 items = incremental ? changed : linkCount.value(view);
+
+      QJsonObject result;
+      result["benchmark"]   = QString("symlnk");
+      result["view"]        = view;
+      result["run"]         = runs[j];
+      result["catalog"]     = archiveName;
+      result["links"]       = linkCount.value(view);
+      result["seconds"]     = stat.seconds;
+      if (incremental)
+      {
+        result["changed"]      = changed;
+        result["photos_per_s"] = items / stat.seconds;
+      }
+      else
+      {
+        result["links_per_s"]  = items / stat.seconds;
+      }
+      result["max_rss_kb"]  = qint64(stat.maxRss);
+      result["syscalls"]    = stat.syscalls;
+      if (strace) result["syscall_list"] = stat.syscallList;
+      result["timestamp"]   = QDateTime::currentDateTime().toString(Qt::ISODate);
+      results.append(result);
+
+      cout << "..." << QString("%1 s, %2 %3/s, %4 MB peak RSS")
+                       .arg(stat.seconds, 0, 'f', 2)
+                       .arg(items / stat.seconds, 0, 'f', 0)
+                       .arg(incremental ? "changed photos" : "links")
+                       .arg(stat.maxRss / 1024);
+      if (strace) cout << ", " << stat.syscalls << " syscalls";
+      cout << endl;
+    }
+  }
+
+  // write the machine readable results
+  QSaveFile resultFile(resultPath);
+  if (!resultFile.open(QIODevice::WriteOnly))
+  {
+    cerr << "ERROR: File " << resultPath << " cannot be written!" << endl;
+    return 1;
+  }
+  resultFile.write(QJsonDocument(results).toJson());
+  resultFile.commit();
+  cout << "Results written to " << resultPath << endl;
+
+  return 0;
+}
+
+bool populate(const QString &archivePath, qint64 photos, quint32 seed)
+{
+  Random random(seed);
+  const char *labels[] = { "anna", "max", "mountain", "lake", "snow", "beach", "party", "city", "night", "friends",
+                           "bike", "zoo", "school", "xmas", "easter", "garden", "museum", "sea", "forest", "dog" };
+  const int labelCount = sizeof(labels) / sizeof(labels[0]);
+  const quint32 sizes[][2] = { { 5760, 3840 }, { 6016, 4016 }, { 3264, 2448 }, { 4000, 6000 }, { 1920, 1080 } };
+  const int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+
+  QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "populate");
+  db.setDatabaseName(archivePath + "/database.s3db");
+  if (!db.open())
+  {
+    return false;
+  }
+
+  {
+    // the catalog is thrown away on failure, durability is not needed here
+    QSqlQuery q(db);
+    q.exec("PRAGMA synchronous=OFF");
+    q.exec("PRAGMA journal_mode=MEMORY");
+
+    QSqlQuery photo(db), tag(db), album(db), exif(db);
+    photo.prepare("INSERT INTO Photos (Id,Name,Hash,Size,Date) VALUES(?,?,?,?,?)");
+    tag.prepare  ("INSERT INTO Tags (Name,PhotoId) VALUES(?,?)");
+    album.prepare("INSERT INTO Albums (Name,PhotoId) VALUES(?,?)");
+    exif.prepare ("INSERT INTO Exif (Make,Model,DateTime,ImageWidth,ImageHeight,PhotoId) VALUES(?,?,?,?,?,?)");
+
+    db.transaction();
+    for (qint64 id = 1; id <= photos; id++)
+    {
+      QDateTime date(QDate(2000 + random.next(16), 1 + random.next(12), 1 + random.next(28)),
+                     QTime(random.next(24), random.next(60), random.next(60)));
+      QString name = QString("%1-%2-%3-%4.JPG")
+                     .arg(date.date().year())
+                     .arg(date.date().month(), 2, 10, QChar('0'))
+                     .arg(date.date().day(),   2, 10, QChar('0'))
+                     .arg(id, 6, 16, QChar('0'))
+                     .toUpper();
+
+      photo.bindValue(0, id);
+      photo.bindValue(1, name);
+      photo.bindValue(2, QString("%1").arg(random.next(), 32, 16, QChar('0')).toUpper());
+      photo.bindValue(3, 500000 + random.next(8000000));
+      photo.bindValue(4, date);
+      if (!photo.exec()) return false;
+
+      // one album (month granularity) and one to three tags per photo
+      album.bindValue(0, QString("%1-%2").arg(date.date().year()).arg(labels[random.next(labelCount)]));
+      album.bindValue(1, id);
+      if (!album.exec()) return false;
+
+      int tags = 1 + random.next(3);
+      for (int i = 0; i < tags; i++)
+      {
+        tag.bindValue(0, QString(labels[random.next(labelCount)]));
+        tag.bindValue(1, id);
+        if (!tag.exec()) return false;
+      }
+
+      // most photos have EXIF data
+      if (random.uniform() < 0.9)
+      {
+        const quint32 *size = sizes[random.next(sizeCount)];
+        exif.bindValue(0, QString("Canon"));
+        exif.bindValue(1, QString("Canon EOS 5D Mark III"));
+        exif.bindValue(2, date.toString("yyyy:MM:dd hh:mm:ss"));
+        exif.bindValue(3, size[0]);
+        exif.bindValue(4, size[1]);
+        exif.bindValue(5, id);
+        if (!exif.exec()) return false;
+      }
+
+      // empty placeholder, the links only need an existing target
+      QFile placeholder(archivePath + "/bulk/" + name);
+      if (!placeholder.open(QIODevice::WriteOnly)) return false;
+      placeholder.close();
+
+      if (id % 100000 == 0)
+      {
+        db.commit();
+        db.transaction();
+        cout << "."; cout.flush();
+      }
+    }
+    db.commit();
+  }
+
+  db.close();
+  return true;
+}
+
+bool prepareRun(const QString &archivePath, const QString &viewPath, const QString &run, qint64 &changed)
+{
+  if (run == "cold")
+  {
+    return QDir(viewPath).removeRecursively();
+  }
+  if (run != "incremental")
+  {
+    return true;
+  }
+
+  // the update triggers log the photos in the change log, the tool only
+  // links these since the watermark of the warm run
+  bool done = false;
+  {
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "prepare");
+    db.setDatabaseName(archivePath + "/database.s3db");
+    if (db.open())
+    {
+      QSqlQuery q(db);
+      done = q.exec(QString("UPDATE Photos SET Status=Status WHERE Photos.Id % %1 = 0").arg(INCREMENTAL_STEP));
+      changed = q.numRowsAffected();
+      q.finish();
+      db.close();
+    }
+  }
+  QSqlDatabase::removeDatabase("prepare");
+  return done;
+}
+
+bool runTool(const QStringList &command, RunStat &stat)
+{
+  QList<QByteArray> arguments;
+  QVector<char*> argv;
+  for (int i = 0; i < command.count(); i++)
+  {
+    arguments.append(command[i].toLocal8Bit());
+  }
+  for (int i = 0; i < arguments.count(); i++)
+  {
+    argv.append(arguments[i].data());
+  }
+  argv.append(0);
+
+  // fork/exec directly, wait4 reports the resource usage of this child only
+  QElapsedTimer timer;
+  timer.start();
+  pid_t pid = fork();
+  if (pid < 0)
+  {
+    return false;
+  }
+  if (pid == 0)
+  {
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) dup2(null, STDOUT_FILENO);
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0)
+  {
+    return false;
+  }
+  stat.seconds = qMax<qint64>(timer.elapsed(), 1) / 1000.0;
+  stat.maxRss  = usage.ru_maxrss;
+
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool countSyscalls(const QStringList &command, RunStat &stat)
+{
+  QTemporaryFile output;
+  if (!output.open())
+  {
+    return false;
+  }
+
+  RunStat straceStat;
+  if (!runTool(QStringList() << "strace" << "-f" << "-c" << "-o" << output.fileName() << command, straceStat))
+  {
+    return false;
+  }
+
+  // summary table: % time, seconds, usecs/call, calls, [errors,] syscall
+  stat.syscalls = 0;
+  QTextStream in(&output);
+  while (!in.atEnd())
+  {
+    QStringList fields = in.readLine().simplified().split(' ');
+    if (fields.count() < 5 || fields.first().startsWith('-') || fields.first() == "%")
+    {
+      continue;
+    }
+    if (fields.last() == "total")
+    {
+      stat.syscalls = fields[3].toLongLong();
+    }
+    else
+    {
+      stat.syscallList[fields.last()] = fields[3].toLongLong();
+    }
+  }
+
+  return true;
+}
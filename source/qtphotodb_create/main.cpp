@@ -22,10 +22,10 @@
 #include "stable.h"
 #include "defines.h"
 #include "options.h"
+#include "logger.h"
 
 QTextStream cout(stdout, QIODevice::WriteOnly);
 QTextStream cerr(stderr, QIODevice::WriteOnly);
-QTextStream clog;
 
 int main(int argc, char *argv[])
 {
@@ -99,26 +99,24 @@ int main(int argc, char *argv[])
 
   // create a log file
   QDateTime logTime = QDateTime::currentDateTime();
-  QFile logFile(rootPath + "/log/" + QString("%1-%2-%3-%4-%5-%6.create.log")
-                                     .arg(logTime.date().year())
-                                     .arg(logTime.date().month(),  2, 10, QChar('0'))
-                                     .arg(logTime.date().day(),    2, 10, QChar('0'))
-                                     .arg(logTime.time().hour(),   2, 10, QChar('0'))
-                                     .arg(logTime.time().minute(), 2, 10, QChar('0'))
-                                     .arg(logTime.time().second(), 2, 10, QChar('0')));
-  logFile.open(QIODevice::WriteOnly);
-  clog.setDevice(&logFile);
+  Logger::open(rootPath + "/log/" + QString("%1-%2-%3-%4-%5-%6.create.log")
+                                    .arg(logTime.date().year())
+                                    .arg(logTime.date().month(),  2, 10, QChar('0'))
+                                    .arg(logTime.date().day(),    2, 10, QChar('0'))
+                                    .arg(logTime.time().hour(),   2, 10, QChar('0'))
+                                    .arg(logTime.time().minute(), 2, 10, QChar('0'))
+                                    .arg(logTime.time().second(), 2, 10, QChar('0')));
 
   cout << "Creating database";
   QSqlQuery query;
-  clog << "Database : " << rootPath + "/database.s3db" << endl;
+  logInfo("database").field("file", rootPath + "/database.s3db");
 
   query.exec("CREATE TABLE [Albums] (                            \n" \
              "  [Id] INTEGER  PRIMARY KEY AUTOINCREMENT NOT NULL,\n" \
              "  [Name] VARCHAR(1024)  NOT NULL,                  \n" \
              "  [PhotoId] INTEGER  NOT NULL                      \n" \
              ");                                                 \n");
-  clog << "Albums : " << query.lastQuery().simplified() << endl; cout << ".";
+  logInfo("table created").field("table", "Albums").field("sql", query.lastQuery().simplified()); cout << ".";
 
   query.exec("CREATE TABLE [Exif] (                              \n" \
              "  [Id] INTEGER  PRIMARY KEY AUTOINCREMENT NOT NULL,\n" \
@@ -132,27 +130,98 @@ int main(int argc, char *argv[])
              "  [Latitude] FLOAT  NULL,                          \n" \
              "  [Longitude] FLOAT  NULL,                         \n" \
              "  [Altitude] FLOAT  NULL,                          \n" \
+             "  [Raw] BLOB  NULL,                                \n" \
+             "  [Duration] FLOAT  NULL,                          \n" \
              "  [PhotoId] INTEGER  NOT NULL                      \n" \
              ");                                                 \n");
-  clog << "Exif : " << query.lastQuery().simplified() << endl; cout << ".";
+  logInfo("table created").field("table", "Exif").field("sql", query.lastQuery().simplified()); cout << ".";
 
   query.exec("CREATE TABLE [Photos] (                            \n" \
              "  [Id] INTEGER  PRIMARY KEY AUTOINCREMENT NOT NULL,\n" \
              "  [Name] VARCHAR(32)  UNIQUE NOT NULL,             \n" \
              "  [Hash] VARCHAR(32)  NOT NULL,                    \n" \
              "  [Size] INTEGER  NOT NULL,                        \n" \
-             "  [Date] TIMESTAMP  NOT NULL                       \n" \
+             "  [Date] TIMESTAMP  NOT NULL,                      \n" \
+             "  [Status] INTEGER DEFAULT 0 NOT NULL,             \n" \
+             "  [Path] VARCHAR(1024)  NULL,                      \n" \
+             "  [ObjectId] INTEGER  NULL,                        \n" \
+             "  [Refs] INTEGER DEFAULT 0 NOT NULL                \n" \
              ");                                                 \n");
-  clog << "Photos : " << query.lastQuery().simplified() << endl; cout << ".";
+  logInfo("table created").field("table", "Photos").field("sql", query.lastQuery().simplified()); cout << ".";
 
   query.exec("CREATE TABLE [Tags] (                              \n" \
              "  [Id] INTEGER  PRIMARY KEY AUTOINCREMENT NOT NULL,\n" \
              "  [Name] VARCHAR(1024)  NOT NULL,                  \n" \
              "  [PhotoId] INTEGER  NOT NULL                      \n" \
              ");                                                 \n");
-  clog << "Tags : " << query.lastQuery().simplified() << endl; cout << ".";
+  logInfo("table created").field("table", "Tags").field("sql", query.lastQuery().simplified()); cout << ".";
+
+  query.exec("CREATE TABLE [ChangeLog] (                         \n" \
+             "  [Seq] INTEGER  PRIMARY KEY AUTOINCREMENT NOT NULL,\n" \
+             "  [PhotoId] INTEGER  NOT NULL                      \n" \
+             ");                                                 \n");
+  logInfo("table created").field("table", "ChangeLog").field("sql", query.lastQuery().simplified()); cout << ".";
+
+  query.exec("CREATE TABLE [Views] (                             \n" \
+             "  [Name] VARCHAR(32)  PRIMARY KEY NOT NULL,        \n" \
+             "  [Watermark] INTEGER  NOT NULL,                   \n" \
+             "  [LinkType] VARCHAR(16) DEFAULT 'symlink' NOT NULL\n" \
+             ");                                                 \n");
+  logInfo("table created").field("table", "Views").field("sql", query.lastQuery().simplified()); cout << ".";
+
+  query.exec("CREATE TABLE [Settings] (                          \n" \
+             "  [Name] VARCHAR(32)  PRIMARY KEY NOT NULL,        \n" \
+             "  [Value] VARCHAR(1024)  NULL                      \n" \
+             ");                                                 \n");
+  logInfo("table created").field("table", "Settings").field("sql", query.lastQuery().simplified()); cout << ".";
+
+  // new archives start flat, qtphotodb_migrate moves them to another layout
+  query.exec("INSERT INTO Settings (Name,Value) VALUES ('BulkLayout','flat')");
+  logInfo("setting created").field("name", "BulkLayout").field("sql", query.lastQuery()); cout << ".";
+
+  // every change of a photo, its tags, albums or exif is logged with the
+  // photo id, qtphotodb_symlnk links only the photos changed since its last run
+  QStringList tables = QStringList() << "Photos" << "Tags" << "Albums" << "Exif";
+  for (int i = 0; i < tables.count(); i++)
+  {
+    QString photoId = (tables[i] == "Photos") ? "Id" : "PhotoId";
+
+    query.exec(QString("CREATE TRIGGER [%1Insert] AFTER INSERT ON [%1] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.%2); END").arg(tables[i]).arg(photoId));
+    logInfo("trigger created").field("table", tables[i]).field("sql", query.lastQuery()); cout << ".";
+    query.exec(QString("CREATE TRIGGER [%1Update] AFTER UPDATE ON [%1] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.%2); END").arg(tables[i]).arg(photoId));
+    logInfo("trigger created").field("table", tables[i]).field("sql", query.lastQuery()); cout << ".";
+    query.exec(QString("CREATE TRIGGER [%1Delete] AFTER DELETE ON [%1] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (OLD.%2); END").arg(tables[i]).arg(photoId));
+    logInfo("trigger created").field("table", tables[i]).field("sql", query.lastQuery()); cout << ".";
+
+    // the views join the changed photos by id
+    if (tables[i] != "Photos")
+    {
+      query.exec(QString("CREATE INDEX [%1PhotoId] ON [%1] (PhotoId)").arg(tables[i]));
+      logInfo("index created").field("table", tables[i]).field("sql", query.lastQuery()); cout << ".";
+    }
+  }
+
+  // photos sharing the file of another photo (Dedup=content) reference it by
+  // ObjectId, the owner counts the references and cannot be deleted while
+  // shared; when it is moved in bulk/ the sharing photos are logged as well
+  QStringList refs;
+  refs << "CREATE TRIGGER [PhotosRefsInsert] AFTER INSERT ON [Photos] WHEN NEW.ObjectId IS NOT NULL BEGIN UPDATE Photos SET Refs = Refs + 1 WHERE Id = NEW.ObjectId; END"
+       << "CREATE TRIGGER [PhotosRefsDelete] AFTER DELETE ON [Photos] WHEN OLD.ObjectId IS NOT NULL BEGIN UPDATE Photos SET Refs = Refs - 1 WHERE Id = OLD.ObjectId; END"
+       << "CREATE TRIGGER [PhotosRefsShared] BEFORE DELETE ON [Photos] WHEN OLD.Refs > 0 BEGIN SELECT RAISE(ABORT, 'photo file is shared'); END"
+       << "CREATE TRIGGER [PhotosRefsMove] AFTER UPDATE OF Path ON [Photos] WHEN NEW.Refs > 0 BEGIN INSERT INTO ChangeLog (PhotoId) SELECT Id FROM Photos WHERE ObjectId = NEW.Id; END";
+  for (int i = 0; i < refs.count(); i++)
+  {
+    query.exec(refs[i]);
+    logInfo("trigger created").field("table", "Photos").field("sql", query.lastQuery()); cout << ".";
+  }
+  query.exec("CREATE INDEX [PhotosObjectId] ON [Photos] (ObjectId)");
+  logInfo("index created").field("table", "Photos").field("sql", query.lastQuery()); cout << ".";
+
+  // duplicates are looked up by hash on every import
+  query.exec("CREATE INDEX [PhotosHash] ON [Photos] (Hash)");
+  logInfo("index created").field("table", "Photos").field("sql", query.lastQuery()); cout << ".";
   cout << "done" << endl;
 
-  logFile.close();
+  Logger::close();
   return 0;
 }
@@ -0,0 +1,460 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "bmff.h"
+
+#include <string.h>
+#include <vector>
+
+// Bounded big-endian reader over a box payload; reading past the end
+// returns zeros and clears 'ok'
+class BoxReader
+{
+  public:
+    BoxReader(const unsigned char *buf, uint64_t pos, uint64_t end) : buf(buf), pos(pos), end(end), ok(true) {}
+
+    uint64_t read(unsigned bytes)
+    {
+      if (pos + bytes > end)
+      {
+        ok = false;
+        pos = end;
+        return 0;
+      }
+      uint64_t value = 0;
+      for (unsigned i = 0; i < bytes; i++)
+      {
+        value = (value << 8) | buf[pos++];
+      }
+      return value;
+    }
+    void skip(uint64_t bytes)
+    {
+      if (bytes > end - pos)
+      {
+        ok = false;
+        pos = end;
+        return;
+      }
+      pos += bytes;
+    }
+
+  public:
+    const unsigned char *buf;
+    uint64_t pos;
+    uint64_t end;
+    bool ok;
+};
+
+struct Box
+{
+  char     type[4];
+  uint64_t offset;          // payload start
+  uint64_t end;             // end of the box
+};
+
+// Reads the box header at 'offs'; the box has to fit before 'end'
+static bool readBox(const unsigned char *buf, uint64_t offs, uint64_t end, Box &box)
+{
+  if (offs > end || end - offs < 8)
+  {
+    return false;
+  }
+  BoxReader r(buf, offs, end);
+  uint64_t size = r.read(4);
+  memcpy(box.type, buf + offs + 4, 4);
+  r.skip(4);
+  if (size == 1)
+  {
+    // 64 bit size after the type
+    size = r.read(8);
+  }
+  else if (size == 0)
+  {
+    // the box extends to the end of the file
+    size = end - offs;
+  }
+  if (!r.ok || size < r.pos - offs || size > end - offs)
+  {
+    return false;
+  }
+  box.offset = r.pos;
+  box.end    = offs + size;
+  return true;
+}
+
+static bool isType(const Box &box, const char *type)
+{
+  return memcmp(box.type, type, 4) == 0;
+}
+
+// HEIF item location (first extent, file offsets only)
+struct ItemLocation
+{
+  uint32_t id;
+  uint64_t offset;
+  uint64_t length;
+};
+
+// HEIF item property association
+struct ItemProperty
+{
+  uint32_t id;
+  unsigned index;
+};
+
+// HEIF image spatial extent / rotation property
+struct ImageProperty
+{
+  unsigned index;
+  unsigned width;
+  unsigned height;
+  int      rotation;        // -1 for spatial extents
+};
+
+static void parseMvhd(const unsigned char *buf, const Box &box, BmffInfo &info)
+{
+  BoxReader r(buf, box.offset, box.end);
+  unsigned version = r.read(1);
+  r.skip(3);
+  uint64_t timescale, duration;
+  if (version == 1)
+  {
+    r.skip(16);
+    timescale = r.read(4);
+    duration  = r.read(8);
+    if (duration == ~static_cast<uint64_t>(0)) duration = 0;
+  }
+  else
+  {
+    r.skip(8);
+    timescale = r.read(4);
+    duration  = r.read(4);
+    if (duration == 0xFFFFFFFF) duration = 0;
+  }
+  if (r.ok && timescale > 0)
+  {
+    info.duration = static_cast<double>(duration) / timescale;
+  }
+}
+
+static void parseTkhd(const unsigned char *buf, const Box &box, BmffInfo &info)
+{
+  // times, track id and duration, then layer, group, volume and the matrix
+  BoxReader r(buf, box.offset, box.end);
+  unsigned version = r.read(1);
+  r.skip(3);
+  r.skip(version == 1 ? 32 : 20);
+  r.skip(16);
+  int32_t a = r.read(4);
+  r.skip(12);
+  int32_t d = r.read(4);
+  r.skip(16);
+  unsigned width  = r.read(4) >> 16;
+  unsigned height = r.read(4) >> 16;
+
+  // audio tracks have no size, the first video track is taken
+  if (r.ok && width > 0 && height > 0 && info.width == 0)
+  {
+    // a rotation by 90 or 270 degrees (portrait clips) swaps the sides
+    bool rotated = (a == 0 && d == 0);
+    info.width  = rotated ? height : width;
+    info.height = rotated ? width  : height;
+  }
+}
+
+static void parseMoov(const unsigned char *buf, const Box &moov, BmffInfo &info)
+{
+  Box box;
+  for (uint64_t offs = moov.offset; readBox(buf, offs, moov.end, box); offs = box.end)
+  {
+    if (isType(box, "mvhd"))
+    {
+      parseMvhd(buf, box, info);
+    }
+    else if (isType(box, "trak"))
+    {
+      Box child;
+      for (uint64_t pos = box.offset; readBox(buf, pos, box.end, child); pos = child.end)
+      {
+        if (isType(child, "tkhd"))
+        {
+          parseTkhd(buf, child, info);
+        }
+      }
+    }
+  }
+}
+
+static void parseIinf(const unsigned char *buf, const Box &iinf, uint32_t &exifItem)
+{
+  BoxReader r(buf, iinf.offset, iinf.end);
+  unsigned version = r.read(1);
+  r.skip(3);
+  r.skip(version == 0 ? 2 : 4);
+
+  Box infe;
+  for (uint64_t offs = r.pos; r.ok && readBox(buf, offs, iinf.end, infe); offs = infe.end)
+  {
+    BoxReader e(buf, infe.offset, infe.end);
+    unsigned infeVersion = e.read(1);
+    e.skip(3);
+    if (!isType(infe, "infe") || infeVersion < 2)
+    {
+      continue;
+    }
+    uint32_t id = e.read(infeVersion == 2 ? 2 : 4);
+    e.skip(2);
+    if (e.ok && e.pos + 4 <= e.end && memcmp(buf + e.pos, "Exif", 4) == 0)
+    {
+      exifItem = id;
+    }
+  }
+}
+
+static void parseIloc(const unsigned char *buf, const Box &iloc, std::vector<ItemLocation> &locations)
+{
+  BoxReader r(buf, iloc.offset, iloc.end);
+  unsigned version = r.read(1);
+  r.skip(3);
+  unsigned sizes          = r.read(1);
+  unsigned offsetSize     = sizes >> 4;
+  unsigned lengthSize     = sizes & 15;
+  sizes                   = r.read(1);
+  unsigned baseOffsetSize = sizes >> 4;
+  unsigned indexSize      = (version == 1 || version == 2) ? (sizes & 15) : 0;
+  uint32_t count          = r.read(version < 2 ? 2 : 4);
+
+  for (uint32_t i = 0; i < count && r.ok; i++)
+  {
+    ItemLocation location;
+    location.id = r.read(version < 2 ? 2 : 4);
+    unsigned method = (version == 1 || version == 2) ? (r.read(2) & 15) : 0;
+    r.skip(2);
+    uint64_t base = r.read(baseOffsetSize);
+    unsigned extents = r.read(2);
+    for (unsigned e = 0; e < extents && r.ok; e++)
+    {
+      r.skip(indexSize);
+      uint64_t offset = r.read(offsetSize);
+      uint64_t length = r.read(lengthSize);
+
+      // only items stored in the file itself (not in idat) with one extent
+      if (e == 0 && extents == 1 && method == 0)
+      {
+        location.offset = base + offset;
+        location.length = length;
+        locations.push_back(location);
+      }
+    }
+  }
+}
+
+static void parseIprp(const unsigned char *buf, const Box &iprp,
+                      std::vector<ImageProperty> &properties,
+                      std::vector<ItemProperty> &associations)
+{
+  Box box;
+  for (uint64_t offs = iprp.offset; readBox(buf, offs, iprp.end, box); offs = box.end)
+  {
+    if (isType(box, "ipco"))
+    {
+      // properties are referenced by their 1-based position
+      Box property;
+      unsigned index = 1;
+      for (uint64_t pos = box.offset; readBox(buf, pos, box.end, property); pos = property.end, index++)
+      {
+        BoxReader r(buf, property.offset, property.end);
+        ImageProperty image;
+        image.index = index;
+        if (isType(property, "ispe"))
+        {
+          r.skip(4);
+          image.width    = r.read(4);
+          image.height   = r.read(4);
+          image.rotation = -1;
+        }
+        else if (isType(property, "irot"))
+        {
+          image.width    = 0;
+          image.height   = 0;
+          image.rotation = r.read(1) & 3;
+        }
+        else
+        {
+          continue;
+        }
+        if (r.ok)
+        {
+          properties.push_back(image);
+        }
+      }
+    }
+    else if (isType(box, "ipma"))
+    {
+      BoxReader r(buf, box.offset, box.end);
+      unsigned version = r.read(1);
+      unsigned flags   = r.read(3);
+      uint32_t count   = r.read(4);
+      for (uint32_t i = 0; i < count && r.ok; i++)
+      {
+        ItemProperty association;
+        association.id = r.read(version < 1 ? 2 : 4);
+        unsigned n = r.read(1);
+        for (unsigned j = 0; j < n && r.ok; j++)
+        {
+          association.index = (flags & 1) ? (r.read(2) & 0x7FFF) : (r.read(1) & 0x7F);
+          associations.push_back(association);
+        }
+      }
+    }
+  }
+}
+
+static void parseMeta(const unsigned char *buf, uint64_t len, const Box &meta, BmffInfo &info)
+{
+  uint32_t primaryItem = 0;
+  uint32_t exifItem = 0;
+  std::vector<ItemLocation> locations;
+  std::vector<ImageProperty> properties;
+  std::vector<ItemProperty> associations;
+
+  // full box: version and flags before the children
+  Box box;
+  for (uint64_t offs = meta.offset + 4; readBox(buf, offs, meta.end, box); offs = box.end)
+  {
+    if (isType(box, "pitm"))
+    {
+      BoxReader r(buf, box.offset, box.end);
+      unsigned version = r.read(1);
+      r.skip(3);
+      primaryItem = r.read(version == 0 ? 2 : 4);
+    }
+    else if (isType(box, "iinf"))
+    {
+      parseIinf(buf, box, exifItem);
+    }
+    else if (isType(box, "iloc"))
+    {
+      parseIloc(buf, box, locations);
+    }
+    else if (isType(box, "iprp"))
+    {
+      parseIprp(buf, box, properties, associations);
+    }
+  }
+
+  // size and rotation of the primary image (for grids the full image)
+  int rotation = 0;
+  for (size_t i = 0; i < associations.size(); i++)
+  {
+    if (associations[i].id != primaryItem)
+    {
+      continue;
+    }
+    for (size_t j = 0; j < properties.size(); j++)
+    {
+      if (properties[j].index != associations[i].index)
+      {
+        continue;
+      }
+      if (properties[j].rotation < 0)
+      {
+        info.width  = properties[j].width;
+        info.height = properties[j].height;
+      }
+      else
+      {
+        rotation = properties[j].rotation;
+      }
+    }
+  }
+  if (rotation == 1 || rotation == 3)
+  {
+    unsigned width = info.width;
+    info.width  = info.height;
+    info.height = width;
+  }
+
+  // the Exif item starts with the offset of the TIFF header in the item,
+  // usually skipping an "Exif\0\0" prefix
+  for (size_t i = 0; exifItem && i < locations.size(); i++)
+  {
+    const ItemLocation &location = locations[i];
+    if (location.id != exifItem || location.length < 4 ||
+        location.offset > len || location.length > len - location.offset)
+    {
+      continue;
+    }
+    BoxReader r(buf, location.offset, location.offset + location.length);
+    uint64_t header = r.read(4);
+    if (header < location.length - 4)
+    {
+      info.exifOffset = location.offset + 4 + header;
+      info.exifLength = location.length - 4 - header;
+    }
+  }
+}
+
+bool isBmff(const unsigned char *buf, uint64_t len)
+{
+  static const char *types[] = { "ftyp", "moov", "mdat", "wide", "free" };
+
+  if (!buf || len < 8)
+  {
+    return false;
+  }
+  for (unsigned i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+  {
+    if (memcmp(buf + 4, types[i], 4) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool parseBmff(const unsigned char *buf, uint64_t len, BmffInfo &info)
+{
+  memset(&info, 0, sizeof(info));
+  if (!isBmff(buf, len))
+  {
+    return false;
+  }
+
+  // top level boxes, a truncated last box ends the walk
+  Box box;
+  bool found = false;
+  for (uint64_t offs = 0; readBox(buf, offs, len, box); offs = box.end)
+  {
+    if (isType(box, "moov"))
+    {
+      parseMoov(buf, box, info);
+    }
+    else if (isType(box, "meta"))
+    {
+      parseMeta(buf, len, box, info);
+    }
+    found = true;
+  }
+
+  return found;
+}
@@ -0,0 +1,46 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef BMFF_H
+#define BMFF_H
+
+#include <stdint.h>
+
+// Metadata of ISO base media files (MP4, MOV, HEIC/HEIF), taken from the
+// box headers only: the media data (mdat) is never looked at, so the file
+// can be mapped as a whole and only a few pages are read.
+struct BmffInfo
+{
+  unsigned width;           // primary image (ispe) or first video track (tkhd)
+  unsigned height;
+  double   duration;        // seconds (mvhd), 0 for still images
+  uint64_t exifOffset;      // TIFF block of the HEIF Exif item in the file
+  uint64_t exifLength;      // 0 if there is no Exif item
+};
+
+// True if the buffer starts with a box a media file starts with
+bool isBmff(const unsigned char *buf, uint64_t len);
+
+// Parses the ftyp, moov and meta boxes of a whole file.
+// RETURN: true if the box structure was readable
+bool parseBmff(const unsigned char *buf, uint64_t len, BmffInfo &info);
+
+#endif // BMFF_H
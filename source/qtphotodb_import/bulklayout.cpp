@@ -0,0 +1,102 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "bulklayout.h"
+
+bool isBulkLayout(const QString &layout)
+{
+  return layout == "flat" || layout == "date" || layout == "hash";
+}
+
+bool isBulkDedup(const QString &dedup)
+{
+  return dedup == "exact" || dedup == "content";
+}
+
+QString bulkPath(const QString &layout, const QString &name, const QString &hash, const QDateTime &date)
+{
+  if (layout == "date")
+  {
+    return QString("%1/%2/%3")
+           .arg(date.date().year(),  4, 10, QChar('0'))
+           .arg(date.date().month(), 2, 10, QChar('0'))
+           .arg(name);
+  }
+  if (layout == "hash" && hash.length() >= 4)
+  {
+    return QString("%1/%2/%3")
+           .arg(hash.mid(0, 2))
+           .arg(hash.mid(2, 2))
+           .arg(name);
+  }
+  return name;
+}
+
+bool readBulkLayout(const QSqlDatabase &db, QString &layout)
+{
+  // databases without settings are flat
+  layout = BULK_LAYOUT_DEFAULT;
+  return readSetting(db, "BulkLayout", layout) && isBulkLayout(layout);
+}
+
+bool readBulkDedup(const QSqlDatabase &db, QString &dedup)
+{
+  dedup = BULK_DEDUP_DEFAULT;
+  return readSetting(db, "Dedup", dedup) && isBulkDedup(dedup);
+}
+
+bool readSetting(const QSqlDatabase &db, const QString &name, QString &value)
+{
+  // a missing setting keeps the default in 'value'
+  if (!db.tables().contains("Settings"))
+  {
+    return true;
+  }
+
+  QSqlQuery q(db);
+  if (!q.prepare("SELECT Settings.Value FROM Settings WHERE Settings.Name=?"))
+  {
+    return false;
+  }
+  q.bindValue(0, name);
+  if (!q.exec())
+  {
+    return false;
+  }
+  if (q.next())
+  {
+    value = q.value(0).toString();
+  }
+  return true;
+}
+
+bool writeSetting(const QSqlDatabase &db, const QString &name, const QString &value)
+{
+  QSqlQuery q(db);
+  if (!q.prepare("INSERT OR REPLACE INTO Settings (Name,Value) VALUES(?,?)"))
+  {
+    return false;
+  }
+  q.bindValue(0, name);
+  q.bindValue(1, value);
+  return q.exec();
+}
@@ -0,0 +1,50 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef BULKLAYOUT_H
+#define BULKLAYOUT_H
+
+// Layouts of the bulk directory, kept in Settings.BulkLayout:
+//   flat - bulk/<name>
+//   date - bulk/<yyyy>/<mm>/<name>  (date of the photo)
+//   hash - bulk/<hh>/<hh>/<name>    (first four digits of the hash)
+// The path of each photo relative to bulk/ is stored in Photos.Path (NULL
+// for bulk/<name>), so an archive stays usable while it is migrated from
+// one layout to another.
+//
+// Duplicates are found by Settings.Dedup:
+//   exact   - same hash, size and date (file time), the default
+//   content - same hash; a photo seen again with another date gets its own
+//             row referencing the first one (Photos.ObjectId), which owns
+//             the file in bulk/ and counts its references (Photos.Refs)
+
+#define BULK_LAYOUT_DEFAULT "flat"
+#define BULK_DEDUP_DEFAULT  "exact"
+
+bool    isBulkLayout  (const QString &layout);
+bool    isBulkDedup   (const QString &dedup);
+QString bulkPath      (const QString &layout, const QString &name, const QString &hash, const QDateTime &date);
+bool    readBulkLayout(const QSqlDatabase &db, QString &layout);
+bool    readBulkDedup (const QSqlDatabase &db, QString &dedup);
+bool    readSetting   (const QSqlDatabase &db, const QString &name, QString &value);
+bool    writeSetting  (const QSqlDatabase &db, const QString &name, const QString &value);
+
+#endif // BULKLAYOUT_H
@@ -33,7 +33,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <stdio.h>
-#include <vector>
+#include <string.h>
 
 using std::string;
 
@@ -50,71 +50,48 @@ struct Rational {
 };
 
 // IF Entry
+//
+// Non-owning view of a directory entry. The entry keeps a pointer to its
+// values inside the source buffer (either the 4 byte value field of the
+// entry itself or the data area the offset points to) and decodes them on
+// access, so parsing an entry never allocates.
 class IFEntry {
  public:
-  using byte_vector = std::vector<uint8_t>;
-  using ascii_vector = std::string;
-  using short_vector = std::vector<uint16_t>;
-  using long_vector = std::vector<uint32_t>;
-  using rational_vector = std::vector<Rational>;
-
   IFEntry()
-      : tag_(0xFF), format_(0xFF), data_(0), length_(0), val_byte_(nullptr) {}
-  IFEntry(const IFEntry &) = delete;
-  IFEntry &operator=(const IFEntry &) = delete;
-  IFEntry(IFEntry &&other)
-      : tag_(other.tag_),
-        format_(other.format_),
-        data_(other.data_),
-        length_(other.length_),
-        val_byte_(other.val_byte_) {
-    other.tag_ = 0xFF;
-    other.format_ = 0xFF;
-    other.data_ = 0;
-    other.length_ = 0;
-    other.val_byte_ = nullptr;
-  }
-  ~IFEntry() { delete_union(); }
+      : tag_(0xFF),
+        format_(0xFF),
+        data_(0),
+        length_(0),
+        value_(nullptr),
+        alignIntel_(true) {}
   unsigned short tag() const { return tag_; }
   void tag(unsigned short tag) { tag_ = tag; }
   unsigned short format() const { return format_; }
-  bool format(unsigned short format) {
-    switch (format) {
-      case 0x01:
-      case 0x02:
-      case 0x03:
-      case 0x04:
-      case 0x05:
-      case 0x07:
-      case 0x09:
-      case 0x0a:
-      case 0xff:
-        break;
-      default:
-        return false;
-    }
-    delete_union();
-    format_ = format;
-    new_union();
-    return true;
-  }
+  void format(unsigned short format) { format_ = format; }
   unsigned data() const { return data_; }
   void data(unsigned data) { data_ = data; }
   unsigned length() const { return length_; }
   void length(unsigned length) { length_ = length; }
+  const unsigned char *value() const { return value_; }
+  bool alignIntel() const { return alignIntel_; }
+  void value(const unsigned char *value, bool alignIntel) {
+    value_ = value;
+    alignIntel_ = alignIntel;
+  }
 
   // functions to access the data
   //
   // !! it's CALLER responsibility to check that format !!
   // !! is correct before accessing it's field          !!
   //
-  // - getters are use here to allow future addition
-  //   of checks if format is correct
-  byte_vector &val_byte() { return *val_byte_; }
-  ascii_vector &val_string() { return *val_string_; }
-  short_vector &val_short() { return *val_short_; }
-  long_vector &val_long() { return *val_long_; }
-  rational_vector &val_rational() { return *val_rational_; }
+  // - out of range indexes return 0
+  // - strings are assigned to the caller's string, so its capacity is
+  //   reused when the same EXIFInfo parses many files
+  uint8_t val_byte(unsigned i) const;
+  uint16_t val_short(unsigned i) const;
+  uint32_t val_long(unsigned i) const;
+  Rational val_rational(unsigned i) const;
+  void val_string(std::string &str) const;
 
  private:
   // Raw fields
@@ -123,86 +100,15 @@ class IFEntry {
   unsigned data_;
   unsigned length_;
 
-  // Parsed fields
-  union {
-    byte_vector *val_byte_;
-    ascii_vector *val_string_;
-    short_vector *val_short_;
-    long_vector *val_long_;
-    rational_vector *val_rational_;
-  };
-
-  void delete_union() {
-    switch (format_) {
-      case 0x1:
-        delete val_byte_;
-        val_byte_ = nullptr;
-        break;
-      case 0x2:
-        delete val_string_;
-        val_string_ = nullptr;
-        break;
-      case 0x3:
-        delete val_short_;
-        val_short_ = nullptr;
-        break;
-      case 0x4:
-        delete val_long_;
-        val_long_ = nullptr;
-        break;
-      case 0x5:
-        delete val_rational_;
-        val_rational_ = nullptr;
-        break;
-      case 0xff:
-        break;
-      default:
-        // should not get here
-        // should I throw an exception or ...?
-        break;
-    }
-  }
-  void new_union() {
-    switch (format_) {
-      case 0x1:
-        val_byte_ = new byte_vector();
-        break;
-      case 0x2:
-        val_string_ = new ascii_vector();
-        break;
-      case 0x3:
-        val_short_ = new short_vector();
-        break;
-      case 0x4:
-        val_long_ = new long_vector();
-        break;
-      case 0x5:
-        val_rational_ = new rational_vector();
-        break;
-      case 0xff:
-        break;
-      default:
-        // should not get here
-        // should I throw an exception or ...?
-        break;
-    }
-  }
+  // View on the values in the source buffer
+  const unsigned char *value_;
+  bool alignIntel_;
 };
 
 // Helper functions
 template <typename T, bool alignIntel>
 T parse(const unsigned char *buf);
 
-template <>
-uint8_t parse<uint8_t, false>(const unsigned char *buf) {
-  return *buf;
-}
-
-template <>
-uint8_t parse<uint8_t, true>(const unsigned char *buf) {
-  return *buf;
-}
-
 template <>
 uint16_t parse<uint16_t, false>(const unsigned char *buf) {
   return (static_cast<uint16_t>(buf[0]) << 8) | buf[1];
@@ -243,47 +149,65 @@ Rational parse<Rational, false>(const unsigned char *buf) {
   return r;
 }
 
-/**
- * Try to read entry.length() values for this entry.
- *
- * Returns:
- *  true  - entry.length() values were read
- *  false - something went wrong, vec's content was not touched
- */
-template <typename T, bool alignIntel, typename C>
-bool extract_values(C &container, const unsigned char *buf, const unsigned base,
-                    const unsigned len, const IFEntry &entry) {
-  const unsigned char *data;
-  uint32_t reversed_data;
-  // if data fits into 4 bytes, they are stored directly in
-  // the data field in IFEntry
-  if (sizeof(T) * entry.length() <= 4) {
-    if (alignIntel) {
-      reversed_data = entry.data();
-    } else {
-      reversed_data = entry.data();
-      // this reversing works, but is ugly
-      unsigned char *data = reinterpret_cast<unsigned char *>(&reversed_data);
-      unsigned char tmp;
-      tmp = data[0];
-      data[0] = data[3];
-      data[3] = tmp;
-      tmp = data[1];
-      data[1] = data[2];
-      data[2] = tmp;
-    }
-    data = reinterpret_cast<const unsigned char *>(&(reversed_data));
-  } else {
-    data = buf + base + entry.data();
-    if (data + sizeof(T) * entry.length() > buf + len) {
-      return false;
-    }
+// Size in bytes of one value of the given format, 0 for unknown formats
+unsigned format_size(unsigned short format) {
+  switch (format) {
+    case 1:
+    case 2:
+    case 7:
+      return 1;
+    case 3:
+      return 2;
+    case 4:
+    case 9:
+    case 13:
+      return 4;
+    case 5:
+    case 10:
+      return 8;
+    default:
+      return 0;
   }
-  container.resize(entry.length());
-  for (size_t i = 0; i < entry.length(); ++i) {
-    container[i] = parse<T, alignIntel>(data + sizeof(T) * i);
+}
+
+uint8_t IFEntry::val_byte(unsigned i) const {
+  return (value_ && i < length_) ? value_[i] : 0;
+}
+
+uint16_t IFEntry::val_short(unsigned i) const {
+  if (!value_ || i >= length_) return 0;
+  return alignIntel_ ? parse<uint16_t, true>(value_ + 2 * i)
+                     : parse<uint16_t, false>(value_ + 2 * i);
+}
+
+uint32_t IFEntry::val_long(unsigned i) const {
+  if (!value_ || i >= length_) return 0;
+  return alignIntel_ ? parse<uint32_t, true>(value_ + 4 * i)
+                     : parse<uint32_t, false>(value_ + 4 * i);
+}
+
+Rational IFEntry::val_rational(unsigned i) const {
+  if (!value_ || i >= length_) {
+    Rational r;
+    r.numerator = 0;
+    r.denominator = 0;
+    return r;
   }
-  return true;
+  return alignIntel_ ? parse<Rational, true>(value_ + 8 * i)
+                     : parse<Rational, false>(value_ + 8 * i);
+}
+
+void IFEntry::val_string(std::string &str) const {
+  // string is basically sequence of uint8_t (well, according to EXIF even
+  // uint7_t, but we don't have that), so just take the bytes and cut the
+  // zero byte at the end, since we don't want that in the std::string
+  if (!value_) {
+    str.clear();
+    return;
+  }
+  unsigned length = length_;
+  if (length > 0 && value_[length - 1] == '\0') length--;
+  str.assign(reinterpret_cast<const char *>(value_), length);
 }
 
 template <bool alignIntel>
@@ -302,79 +226,43 @@ void parseIFEntryHeader(const unsigned char *buf, unsigned short &tag,
 }
 
 template <bool alignIntel>
-void parseIFEntryHeader(const unsigned char *buf, IFEntry &result) {
+IFEntry parseIFEntry_temp(const unsigned char *buf, const unsigned offs,
+                          const unsigned base, const unsigned len) {
+  IFEntry result;
+
+  // check if there even is enough data for IFEntry in the buffer
+  if (static_cast<uint64_t>(offs) + 12 > len) {
+    result.tag(0xFF);
+    return result;
+  }
+
   unsigned short tag;
   unsigned short format;
   unsigned length;
   unsigned data;
-
-  parseIFEntryHeader<alignIntel>(buf, tag, format, length, data);
-
+  parseIFEntryHeader<alignIntel>(buf + offs, tag, format, length, data);
   result.tag(tag);
   result.format(format);
   result.length(length);
   result.data(data);
-}
 
-template <bool alignIntel>
-IFEntry parseIFEntry_temp(const unsigned char *buf, const unsigned offs,
-                          const unsigned base, const unsigned len) {
-  IFEntry result;
-
-  // check if there even is enough data for IFEntry in the buffer
-  if (buf + offs + 12 > buf + len) {
+  unsigned size = format_size(format);
+  if (!size) {
     result.tag(0xFF);
     return result;
   }
 
-  parseIFEntryHeader<alignIntel>(buf + offs, result);
-
-  // Parse value in specified format
-  switch (result.format()) {
-    case 1:
-      if (!extract_values<uint8_t, alignIntel>(result.val_byte(), buf, base,
-                                               len, result)) {
-        result.tag(0xFF);
-      }
-      break;
-    case 2:
-      // string is basically sequence of uint8_t (well, according to EXIF even
-      // uint7_t, but
-      // we don't have that), so just read it as bytes
-      if (!extract_values<uint8_t, alignIntel>(result.val_string(), buf, base,
-                                               len, result)) {
-        result.tag(0xFF);
-      }
-      // and cut zero byte at the end, since we don't want that in the
-      // std::string
-      if (result.val_string()[result.val_string().length() - 1] == '\0') {
-        result.val_string().resize(result.val_string().length() - 1);
-      }
-      break;
-    case 3:
-      if (!extract_values<uint16_t, alignIntel>(result.val_short(), buf, base,
-                                                len, result)) {
-        result.tag(0xFF);
-      }
-      break;
-    case 4:
-      if (!extract_values<uint32_t, alignIntel>(result.val_long(), buf, base,
-                                                len, result)) {
-        result.tag(0xFF);
-      }
-      break;
-    case 5:
-      if (!extract_values<Rational, alignIntel>(result.val_rational(), buf,
-                                                base, len, result)) {
-        result.tag(0xFF);
-      }
-      break;
-    case 7:
-    case 9:
-    case 10:
-      break;
-    default:
-      result.tag(0xFF);
+  // if data fits into 4 bytes, they are stored directly in the data field
+  // of the entry (left aligned, in the same byte order), otherwise data is
+  // the offset of the values relative to the TIFF header
+  uint64_t total = static_cast<uint64_t>(size) * length;
+  if (total <= 4) {
+    result.value(buf + offs + 8, alignIntel);
+  } else if (static_cast<uint64_t>(base) + data + total <= len) {
+    result.value(buf + base + data, alignIntel);
+  } else if (format != 7 && format != 9 && format != 10) {
+    // values out of the buffer, the entry is not usable
+    result.tag(0xFF);
   }
   return result;
 }
@@ -389,23 +277,13 @@ T parse_value(const unsigned char *buf, bool alignIntel) {
   }
 }
 
-void parseIFEntryHeader(const unsigned char *buf, bool alignIntel,
-                        unsigned short &tag, unsigned short &format,
-                        unsigned &length, unsigned &data) {
-  if (alignIntel) {
-    parseIFEntryHeader<true>(buf, tag, format, length, data);
-  } else {
-    parseIFEntryHeader<false>(buf, tag, format, length, data);
-  }
-}
-
 IFEntry parseIFEntry(const unsigned char *buf, const unsigned offs,
                      const bool alignIntel, const unsigned base,
                      const unsigned len) {
   if (alignIntel) {
-    return std::move(parseIFEntry_temp<true>(buf, offs, base, len));
+    return parseIFEntry_temp<true>(buf, offs, base, len);
   } else {
-    return std::move(parseIFEntry_temp<false>(buf, offs, base, len));
+    return parseIFEntry_temp<false>(buf, offs, base, len);
   }
 }
 }
@@ -413,33 +291,27 @@ IFEntry parseIFEntry(const unsigned char *buf, const unsigned offs,
 //
 // Locates the EXIF segment and parses it using parseFromEXIFSegment
 //
-int easyexif::EXIFInfo::parseFrom(const unsigned char *buf, unsigned len) {
-  // Sanity check: all JPEG files start with 0xFFD8.
+int easyexif::EXIFInfo::parseFrom(const unsigned char *buf, unsigned len,
+                                  unsigned fields) {
   if (!buf || len < 4) return PARSE_EXIF_ERROR_NO_JPEG;
-  if (buf[0] != 0xFF || buf[1] != 0xD8) return PARSE_EXIF_ERROR_NO_JPEG;
 
-  // Sanity check: some cameras pad the JPEG image with null bytes at the end.
-  // Normally, we should able to find the JPEG end marker 0xFFD9 at the end
-  // of the image, but not always. As long as there are null/0xFF bytes at the
-  // end of the image buffer, keep decrementing len until an 0xFFD9 is found,
-  // or some other bytes are. If the first non-zero/0xFF bytes from the end are
-  // not 0xFFD9, then we can be reasonably sure that the buffer is not a JPEG.
-  while (len > 2) {
-    if (buf[len - 1] == 0 || buf[len - 1] == 0xFF) {
-      len--;
-    } else {
-      if (buf[len - 1] != 0xD9 || buf[len - 2] != 0xFF) {
-        return PARSE_EXIF_ERROR_NO_JPEG;
-      } else {
-        break;
-      }
-    }
+  // TIFF based files (TIFF and the CR2, NEF, ARW, DNG raw formats) are a
+  // TIFF block as a whole, their directories can be anywhere in the file.
+  if (std::equal(buf, buf + 4, "II*\0") || std::equal(buf, buf + 4, "MM\0*")) {
+    clear();
+    return parseFromTIFF(buf, len, fields);
   }
+
+  // Sanity check: all JPEG files start with 0xFFD8.
+  if (buf[0] != 0xFF || buf[1] != 0xD8) return PARSE_EXIF_ERROR_NO_JPEG;
   clear();
 
-  // Scan for EXIF header (bytes 0xFF 0xE1) and do a sanity check by
-  // looking for bytes "Exif\0\0". The marker length data is in Motorola
-  // byte order, which results in the 'false' parameter to parse16().
+  // Walk the marker segments starting after SOI, following the segment
+  // lengths, until the EXIF segment (0xFF 0xE1 with "Exif\0\0") is found.
+  // All metadata segments come before the image data, so the walk stops at
+  // the start of scan (SOS) or end of image (EOI) marker and only the file
+  // prefix up to there is ever looked at. The marker length data is in
+  // Motorola byte order, which results in the 'false' parameter to parse16().
   // The marker has to contain at least the TIFF header, otherwise the
   // EXIF data is corrupt. So the minimum length specified here has to be:
   //   2 bytes: section size
@@ -449,44 +321,351 @@ int easyexif::EXIFInfo::parseFrom(const unsigned char *buf, unsigned len) {
   //   4 bytes: Offset to first IFD
   // =========
   //  16 bytes
-  unsigned offs = 0;  // current offset into buffer
-  for (offs = 0; offs < len - 1; offs++)
-    if (buf[offs] == 0xFF && buf[offs + 1] == 0xE1) break;
-  if (offs + 4 > len) return PARSE_EXIF_ERROR_NO_EXIF;
-  offs += 2;
-  unsigned short section_length = parse_value<uint16_t>(buf + offs, false);
-  if (offs + section_length > len || section_length < 16)
-    return PARSE_EXIF_ERROR_CORRUPT;
-  offs += 2;
+  unsigned offs = 2;  // current offset into buffer
+  while (offs + 4 <= len) {
+    // Not on a marker (garbage or a wrong segment length): resynchronize on
+    // the next 0xFF byte, memchr does this scan a word/vector at a time.
+    if (buf[offs] != 0xFF) {
+      const void *next = memchr(buf + offs, 0xFF, len - offs);
+      if (!next) break;
+      offs = static_cast<const unsigned char *>(next) - buf;
+      continue;
+    }
+
+    unsigned char marker = buf[offs + 1];
+    if (marker == 0xFF) {
+      // fill byte before a marker
+      offs++;
+      continue;
+    }
+    if (marker == 0x00 || marker == 0x01 || marker == 0xD8 ||
+        (marker >= 0xD0 && marker <= 0xD7)) {
+      // markers without a length field
+      offs += 2;
+      continue;
+    }
+    if (marker == 0xDA || marker == 0xD9) {
+      // start of scan / end of image: no more metadata segments
+      break;
+    }
+
+    unsigned short section_length = parse_value<uint16_t>(buf + offs + 2, false);
+    if (section_length < 2) {
+      offs += 2;
+      continue;
+    }
+    if (marker == 0xE1 && offs + 10 <= len &&
+        std::equal(buf + offs + 4, buf + offs + 10, "Exif\0\0")) {
+      offs += 2;
+      if (offs + section_length > len || section_length < 16)
+        return PARSE_EXIF_ERROR_CORRUPT;
+      offs += 2;
+      int code = parseFromEXIFSegment(buf + offs, len - offs, fields);
+      // the TIFF block position in 'buf', limited to the APP1 segment
+      TiffOffset += offs;
+      TiffLength = section_length - 8;
+      return code;
+    }
+    offs += 2 + section_length;
+  }
+
+  return PARSE_EXIF_ERROR_NO_EXIF;
+}
+
+int easyexif::EXIFInfo::parseFrom(const string &data, unsigned fields) {
+  return parseFrom((const unsigned char *)data.data(), data.length(), fields);
+}
+
+namespace {
+
+using easyexif::EXIFInfo;
+
+// State shared by the tag handlers while parsing one EXIF segment
+struct ParseState {
+  EXIFInfo *info;
+  unsigned tiff_header_start;
+  uint64_t exif_sub_ifd_offset;  // 64 bit, the pointers are not trusted
+  uint64_t gps_sub_ifd_offset;
+};
+
+typedef void (*TagHandler)(ParseState &state, const IFEntry &entry);
+
+// One known tag of a directory: the field(s) it fills and its decoder
+struct TagInfo {
+  unsigned short tag;
+  unsigned fields;
+  TagHandler handler;
+};
+
+// Generic decoders for fields stored directly in EXIFInfo
+template <string EXIFInfo::*member>
+void string_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 2) entry.val_string(state.info->*member);
+}
+
+template <unsigned short EXIFInfo::*member>
+void short_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 3) state.info->*member = entry.val_short(0);
+}
+
+template <double EXIFInfo::*member>
+void rational_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 5) state.info->*member = entry.val_rational(0);
+}
 
-  return parseFromEXIFSegment(buf + offs, len - offs);
+template <unsigned EXIFInfo::*member>
+void dimension_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 4) state.info->*member = entry.val_long(0);
+  if (entry.format() == 3) state.info->*member = entry.val_short(0);
 }
 
-int easyexif::EXIFInfo::parseFrom(const string &data) {
-  return parseFrom((const unsigned char *)data.data(), data.length());
+// IFD0 pointers to the sub-directories
+void exif_sub_ifd_tag(ParseState &state, const IFEntry &entry) {
+  state.exif_sub_ifd_offset =
+      static_cast<uint64_t>(state.tiff_header_start) + entry.data();
+}
+
+void gps_sub_ifd_tag(ParseState &state, const IFEntry &entry) {
+  state.gps_sub_ifd_offset =
+      static_cast<uint64_t>(state.tiff_header_start) + entry.data();
+}
+
+// EXIF SubIFD decoders for fields which need more than one assignment
+void flash_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 3) state.info->Flash = entry.data() ? 1 : 0;
+}
+
+void focal_plane_x_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 5)
+    state.info->LensInfo.FocalPlaneXResolution = entry.val_rational(0);
+}
+
+void focal_plane_y_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 5)
+    state.info->LensInfo.FocalPlaneYResolution = entry.val_rational(0);
+}
+
+void lens_info_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 5) {
+    state.info->LensInfo.FocalLengthMin = entry.val_rational(0);
+    state.info->LensInfo.FocalLengthMax = entry.val_rational(1);
+    state.info->LensInfo.FStopMin = entry.val_rational(2);
+    state.info->LensInfo.FStopMax = entry.val_rational(3);
+  }
+}
+
+void lens_make_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 2) entry.val_string(state.info->LensInfo.Make);
+}
+
+void lens_model_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 2) entry.val_string(state.info->LensInfo.Model);
+}
+
+// GPS SubIFD decoders, the reference tags may come before or after the
+// values they refer to
+void gps_coord(const IFEntry &entry, EXIFInfo::Geolocation_t::Coord_t &coord,
+               double &value) {
+  if (entry.format() == 5 && entry.length() == 3) {
+    coord.degrees = entry.val_rational(0);
+    coord.minutes = entry.val_rational(1);
+    coord.seconds = entry.val_rational(2);
+    value = coord.degrees + coord.minutes / 60 + coord.seconds / 3600;
+  }
+}
+
+void gps_lat_ref_tag(ParseState &state, const IFEntry &entry) {
+  EXIFInfo::Geolocation_t &geo = state.info->GeoLocation;
+  geo.LatComponents.direction = entry.val_byte(0);
+  if (geo.LatComponents.direction == 0) geo.LatComponents.direction = '?';
+  if ('S' == geo.LatComponents.direction) geo.Latitude = -geo.Latitude;
+}
+
+void gps_lat_tag(ParseState &state, const IFEntry &entry) {
+  EXIFInfo::Geolocation_t &geo = state.info->GeoLocation;
+  gps_coord(entry, geo.LatComponents, geo.Latitude);
+  if (entry.format() == 5 && entry.length() == 3 &&
+      'S' == geo.LatComponents.direction)
+    geo.Latitude = -geo.Latitude;
+}
+
+void gps_lon_ref_tag(ParseState &state, const IFEntry &entry) {
+  EXIFInfo::Geolocation_t &geo = state.info->GeoLocation;
+  geo.LonComponents.direction = entry.val_byte(0);
+  if (geo.LonComponents.direction == 0) geo.LonComponents.direction = '?';
+  if ('W' == geo.LonComponents.direction) geo.Longitude = -geo.Longitude;
+}
+
+void gps_lon_tag(ParseState &state, const IFEntry &entry) {
+  EXIFInfo::Geolocation_t &geo = state.info->GeoLocation;
+  gps_coord(entry, geo.LonComponents, geo.Longitude);
+  if (entry.format() == 5 && entry.length() == 3 &&
+      'W' == geo.LonComponents.direction)
+    geo.Longitude = -geo.Longitude;
+}
+
+void gps_alt_ref_tag(ParseState &state, const IFEntry &entry) {
+  EXIFInfo::Geolocation_t &geo = state.info->GeoLocation;
+  geo.AltitudeRef = entry.val_byte(0);
+  if (1 == geo.AltitudeRef) geo.Altitude = -geo.Altitude;
+}
+
+void gps_alt_tag(ParseState &state, const IFEntry &entry) {
+  EXIFInfo::Geolocation_t &geo = state.info->GeoLocation;
+  if (entry.format() == 5) {
+    geo.Altitude = entry.val_rational(0);
+    if (1 == geo.AltitudeRef) geo.Altitude = -geo.Altitude;
+  }
+}
+
+void gps_dop_tag(ParseState &state, const IFEntry &entry) {
+  if (entry.format() == 5)
+    state.info->GeoLocation.DOP = entry.val_rational(0);
+}
+
+// Tag tables, sorted by tag (checked at compile time)
+constexpr TagInfo ifd0_tags[] = {
+    {0x102, EXIFInfo::FIELD_BITS_PER_SAMPLE, short_tag<&EXIFInfo::BitsPerSample>},
+    {0x10E, EXIFInfo::FIELD_IMAGE_DESCRIPTION, string_tag<&EXIFInfo::ImageDescription>},
+    {0x10F, EXIFInfo::FIELD_MAKE, string_tag<&EXIFInfo::Make>},
+    {0x110, EXIFInfo::FIELD_MODEL, string_tag<&EXIFInfo::Model>},
+    {0x112, EXIFInfo::FIELD_ORIENTATION, short_tag<&EXIFInfo::Orientation>},
+    {0x131, EXIFInfo::FIELD_SOFTWARE, string_tag<&EXIFInfo::Software>},
+    {0x132, EXIFInfo::FIELD_DATE_TIME, string_tag<&EXIFInfo::DateTime>},
+    {0x8298, EXIFInfo::FIELD_COPYRIGHT, string_tag<&EXIFInfo::Copyright>},
+    {0x8769, EXIFInfo::FIELD_EXIF_MASK, exif_sub_ifd_tag},
+    {0x8825, EXIFInfo::FIELD_GPS_MASK, gps_sub_ifd_tag},
+};
+
+constexpr TagInfo exif_tags[] = {
+    {0x829a, EXIFInfo::FIELD_EXPOSURE_TIME, rational_tag<&EXIFInfo::ExposureTime>},
+    {0x829d, EXIFInfo::FIELD_F_NUMBER, rational_tag<&EXIFInfo::FNumber>},
+    {0x8827, EXIFInfo::FIELD_ISO_SPEED_RATINGS, short_tag<&EXIFInfo::ISOSpeedRatings>},
+    {0x9003, EXIFInfo::FIELD_DATE_TIME_ORIGINAL, string_tag<&EXIFInfo::DateTimeOriginal>},
+    {0x9004, EXIFInfo::FIELD_DATE_TIME_DIGITIZED, string_tag<&EXIFInfo::DateTimeDigitized>},
+    {0x9201, EXIFInfo::FIELD_SHUTTER_SPEED_VALUE, rational_tag<&EXIFInfo::ShutterSpeedValue>},
+    {0x9204, EXIFInfo::FIELD_EXPOSURE_BIAS_VALUE, rational_tag<&EXIFInfo::ExposureBiasValue>},
+    {0x9206, EXIFInfo::FIELD_SUBJECT_DISTANCE, rational_tag<&EXIFInfo::SubjectDistance>},
+    {0x9207, EXIFInfo::FIELD_METERING_MODE, short_tag<&EXIFInfo::MeteringMode>},
+    {0x9209, EXIFInfo::FIELD_FLASH, flash_tag},
+    {0x920a, EXIFInfo::FIELD_FOCAL_LENGTH, rational_tag<&EXIFInfo::FocalLength>},
+    {0x9291, EXIFInfo::FIELD_SUB_SEC_TIME_ORIGINAL, string_tag<&EXIFInfo::SubSecTimeOriginal>},
+    {0xa002, EXIFInfo::FIELD_IMAGE_WIDTH, dimension_tag<&EXIFInfo::ImageWidth>},
+    {0xa003, EXIFInfo::FIELD_IMAGE_HEIGHT, dimension_tag<&EXIFInfo::ImageHeight>},
+    {0xa20e, EXIFInfo::FIELD_FOCAL_PLANE_RES, focal_plane_x_tag},
+    {0xa20f, EXIFInfo::FIELD_FOCAL_PLANE_RES, focal_plane_y_tag},
+    {0xa405, EXIFInfo::FIELD_FOCAL_LENGTH_IN_35MM, short_tag<&EXIFInfo::FocalLengthIn35mm>},
+    {0xa432, EXIFInfo::FIELD_LENS_INFO, lens_info_tag},
+    {0xa433, EXIFInfo::FIELD_LENS_MAKE, lens_make_tag},
+    {0xa434, EXIFInfo::FIELD_LENS_MODEL, lens_model_tag},
+};
+
+constexpr TagInfo gps_tags[] = {
+    {1, EXIFInfo::FIELD_GEO_LOCATION, gps_lat_ref_tag},
+    {2, EXIFInfo::FIELD_GEO_LOCATION, gps_lat_tag},
+    {3, EXIFInfo::FIELD_GEO_LOCATION, gps_lon_ref_tag},
+    {4, EXIFInfo::FIELD_GEO_LOCATION, gps_lon_tag},
+    {5, EXIFInfo::FIELD_GEO_LOCATION, gps_alt_ref_tag},
+    {6, EXIFInfo::FIELD_GEO_LOCATION, gps_alt_tag},
+    {11, EXIFInfo::FIELD_GEO_LOCATION, gps_dop_tag},
+};
+
+template <unsigned N>
+constexpr bool tags_sorted(const TagInfo (&tags)[N], unsigned i = 1) {
+  return i >= N || (tags[i - 1].tag < tags[i].tag && tags_sorted(tags, i + 1));
+}
+
+template <unsigned N>
+constexpr unsigned tags_fields(const TagInfo (&tags)[N], unsigned i = 0) {
+  return i >= N ? 0 : (tags[i].fields | tags_fields(tags, i + 1));
+}
+
+static_assert(tags_sorted(ifd0_tags), "IFD0 tag table is not sorted");
+static_assert(tags_sorted(exif_tags), "EXIF tag table is not sorted");
+static_assert(tags_sorted(gps_tags), "GPS tag table is not sorted");
+static_assert(tags_fields(exif_tags) == EXIFInfo::FIELD_EXIF_MASK,
+              "EXIF tag table does not match FIELD_EXIF_MASK");
+static_assert(tags_fields(gps_tags) == EXIFInfo::FIELD_GPS_MASK,
+              "GPS tag table does not match FIELD_GPS_MASK");
+
+template <unsigned N>
+const TagInfo *find_tag(const TagInfo (&tags)[N], unsigned short tag) {
+  unsigned low = 0, high = N;
+  while (low < high) {
+    unsigned middle = (low + high) / 2;
+    if (tags[middle].tag < tag)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return (low < N && tags[low].tag == tag) ? &tags[low] : nullptr;
+}
+
+// Parses the directory at 'offs' and hands every known and requested entry
+// to its handler. Only the tag is read for entries which are not needed.
+template <unsigned N>
+int parse_ifd(const TagInfo (&tags)[N], ParseState &state, unsigned fields,
+              const unsigned char *buf, uint64_t offs, bool alignIntel,
+              unsigned len) {
+  // the offsets come from the file, the checks are done in 64 bit so a
+  // crafted offset cannot wrap around
+  if (offs + 2 > len) return PARSE_EXIF_ERROR_CORRUPT;
+  int num_entries = parse_value<uint16_t>(buf + offs, alignIntel);
+  if (offs + 6 + 12 * static_cast<uint64_t>(num_entries) > len)
+    return PARSE_EXIF_ERROR_CORRUPT;
+  offs += 2;
+  while (--num_entries >= 0) {
+    const TagInfo *tag =
+        find_tag(tags, parse_value<uint16_t>(buf + offs, alignIntel));
+    if (tag && (tag->fields & fields)) {
+      IFEntry entry =
+          parseIFEntry(buf, offs, alignIntel, state.tiff_header_start, len);
+      if (entry.tag() != 0xFF) tag->handler(state, entry);
+    }
+    offs += 12;
+  }
+  return PARSE_EXIF_SUCCESS;
+}
 }
 
 //
-// Main parsing function for an EXIF segment.
+// Parsing function for an EXIF segment.
 //
 // PARAM: 'buf' start of the EXIF TIFF, which must be the bytes "Exif\0\0".
 // PARAM: 'len' length of buffer
+// PARAM: 'fields' fields to decode (FIELD_* flags)
 //
 int easyexif::EXIFInfo::parseFromEXIFSegment(const unsigned char *buf,
-                                             unsigned len) {
-  bool alignIntel = true;  // byte alignment (defined in EXIF header)
-  unsigned offs = 0;       // current offset into buffer
+                                             unsigned len, unsigned fields) {
   if (!buf || len < 6) return PARSE_EXIF_ERROR_NO_EXIF;
-
   if (!std::equal(buf, buf + 6, "Exif\0\0")) return PARSE_EXIF_ERROR_NO_EXIF;
-  offs += 6;
+
+  int code = parseFromTIFF(buf + 6, len - 6, fields);
+  TiffOffset += 6;
+  return code;
+}
+
+//
+// Main parsing function for a TIFF block. All offsets in the block are
+// relative to its start.
+//
+// PARAM: 'buf' start of the TIFF header ("II" or "MM").
+// PARAM: 'len' length of buffer
+// PARAM: 'fields' fields to decode (FIELD_* flags)
+//
+int easyexif::EXIFInfo::parseFromTIFF(const unsigned char *buf, unsigned len,
+                                      unsigned fields) {
+  bool alignIntel = true;  // byte alignment (defined in EXIF header)
+  unsigned offs = 0;       // current offset into buffer
+  if (!buf) return PARSE_EXIF_ERROR_NO_EXIF;
+  TiffOffset = 0;
+  TiffLength = len;
 
   // Now parsing the TIFF header. The first two bytes are either "II" or
   // "MM" for Intel or Motorola byte alignment. Sanity check by parsing
   // the unsigned short that follows, making sure it equals 0x2a. The
-  // last 4 bytes are an offset into the first IFD, which are added to
-  // the global offset counter. For this block, we expect the following
-  // minimum size:
+  // last 4 bytes are an offset into the first IFD. For this block, we
+  // expect the following minimum size:
   //  2 bytes: 'II' or 'MM'
   //  2 bytes: 0x002a
   //  4 bytes: offset to first IDF
@@ -507,9 +686,10 @@ int easyexif::EXIFInfo::parseFromEXIFSegment(const unsigned char *buf,
   if (0x2a != parse_value<uint16_t>(buf + offs, alignIntel))
     return PARSE_EXIF_ERROR_CORRUPT;
   offs += 2;
-  unsigned first_ifd_offset = parse_value<uint32_t>(buf + offs, alignIntel);
-  offs += first_ifd_offset - 4;
-  if (offs >= len) return PARSE_EXIF_ERROR_CORRUPT;
+  uint64_t ifd0_offs = static_cast<uint64_t>(tiff_header_start) +
+                      parse_value<uint32_t>(buf + offs, alignIntel);
+  if (ifd0_offs >= len) return PARSE_EXIF_ERROR_CORRUPT;
+  offs = static_cast<unsigned>(ifd0_offs);
 
   // Now parsing the first Image File Directory (IFD0, for the main image).
   // An IFD consists of a variable number of 12-byte directory entries. The
@@ -517,319 +697,31 @@ int easyexif::EXIFInfo::parseFromEXIFSegment(const unsigned char *buf,
   // entries in the section. The last 4 bytes of the IFD contain an offset
   // to the next IFD, which means this IFD must contain exactly 6 + 12 * num
   // bytes of data.
-  if (offs + 2 > len) return PARSE_EXIF_ERROR_CORRUPT;
-  int num_entries = parse_value<uint16_t>(buf + offs, alignIntel);
-  if (offs + 6 + 12 * num_entries > len) return PARSE_EXIF_ERROR_CORRUPT;
-  offs += 2;
-  unsigned exif_sub_ifd_offset = len;
-  unsigned gps_sub_ifd_offset = len;
-  while (--num_entries >= 0) {
-    IFEntry result =
-        parseIFEntry(buf, offs, alignIntel, tiff_header_start, len);
-    offs += 12;
-    switch (result.tag()) {
-      case 0x102:
-        // Bits per sample
-        if (result.format() == 3)
-          this->BitsPerSample = result.val_short().front();
-        break;
-
-      case 0x10E:
-        // Image description
-        if (result.format() == 2) this->ImageDescription = result.val_string();
-        break;
-
-      case 0x10F:
-        // Digicam make
-        if (result.format() == 2) this->Make = result.val_string();
-        break;
-
-      case 0x110:
-        // Digicam model
-        if (result.format() == 2) this->Model = result.val_string();
-        break;
-
-      case 0x112:
-        // Orientation of image
-        if (result.format() == 3)
-          this->Orientation = result.val_short().front();
-        break;
-
-      case 0x131:
-        // Software used for image
-        if (result.format() == 2) this->Software = result.val_string();
-        break;
-
-      case 0x132:
-        // EXIF/TIFF date/time of image modification
-        if (result.format() == 2) this->DateTime = result.val_string();
-        break;
-
-      case 0x8298:
-        // Copyright information
-        if (result.format() == 2) this->Copyright = result.val_string();
-        break;
-
-      case 0x8825:
-        // GPS IFS offset
-        gps_sub_ifd_offset = tiff_header_start + result.data();
-        break;
-
-      case 0x8769:
-        // EXIF SubIFD offset
-        exif_sub_ifd_offset = tiff_header_start + result.data();
-        break;
-    }
-  }
+  ParseState state;
+  state.info = this;
+  state.tiff_header_start = tiff_header_start;
+  state.exif_sub_ifd_offset = len;
+  state.gps_sub_ifd_offset = len;
+  int code = parse_ifd(ifd0_tags, state, fields, buf, offs, alignIntel, len);
+  if (code) return code;
 
   // Jump to the EXIF SubIFD if it exists and parse all the information
   // there. Note that it's possible that the EXIF SubIFD doesn't exist.
   // The EXIF SubIFD contains most of the interesting information that a
-  // typical user might want.
-  if (exif_sub_ifd_offset + 4 <= len) {
-    offs = exif_sub_ifd_offset;
-    int num_entries = parse_value<uint16_t>(buf + offs, alignIntel);
-    if (offs + 6 + 12 * num_entries > len) return PARSE_EXIF_ERROR_CORRUPT;
-    offs += 2;
-    while (--num_entries >= 0) {
-      IFEntry result =
-          parseIFEntry(buf, offs, alignIntel, tiff_header_start, len);
-      switch (result.tag()) {
-        case 0x829a:
-          // Exposure time in seconds
-          if (result.format() == 5)
-            this->ExposureTime = result.val_rational().front();
-          break;
-
-        case 0x829d:
-          // FNumber
-          if (result.format() == 5)
-            this->FNumber = result.val_rational().front();
-          break;
-
-        case 0x8827:
-          // ISO Speed Rating
-          if (result.format() == 3)
-            this->ISOSpeedRatings = result.val_short().front();
-          break;
-
-        case 0x9003:
-          // Original date and time
-          if (result.format() == 2)
-            this->DateTimeOriginal = result.val_string();
-          break;
-
-        case 0x9004:
-          // Digitization date and time
-          if (result.format() == 2)
-            this->DateTimeDigitized = result.val_string();
-          break;
-
-        case 0x9201:
-          // Shutter speed value
-          if (result.format() == 5)
-            this->ShutterSpeedValue = result.val_rational().front();
-          break;
-
-        case 0x9204:
-          // Exposure bias value
-          if (result.format() == 5)
-            this->ExposureBiasValue = result.val_rational().front();
-          break;
-
-        case 0x9206:
-          // Subject distance
-          if (result.format() == 5)
-            this->SubjectDistance = result.val_rational().front();
-          break;
-
-        case 0x9209:
-          // Flash used
-          if (result.format() == 3) this->Flash = result.data() ? 1 : 0;
-          break;
-
-        case 0x920a:
-          // Focal length
-          if (result.format() == 5)
-            this->FocalLength = result.val_rational().front();
-          break;
-
-        case 0x9207:
-          // Metering mode
-          if (result.format() == 3)
-            this->MeteringMode = result.val_short().front();
-          break;
-
-        case 0x9291:
-          // Subsecond original time
-          if (result.format() == 2)
-            this->SubSecTimeOriginal = result.val_string();
-          break;
-
-        case 0xa002:
-          // EXIF Image width
-          if (result.format() == 4)
-            this->ImageWidth = result.val_long().front();
-          if (result.format() == 3)
-            this->ImageWidth = result.val_short().front();
-          break;
-
-        case 0xa003:
-          // EXIF Image height
-          if (result.format() == 4)
-            this->ImageHeight = result.val_long().front();
-          if (result.format() == 3)
-            this->ImageHeight = result.val_short().front();
-          break;
-
-        case 0xa20e:
-          // EXIF Focal plane X-resolution
-          if (result.format() == 5) {
-            this->LensInfo.FocalPlaneXResolution = result.val_rational()[0];
-          }
-          break;
-
-        case 0xa20f:
-          // EXIF Focal plane Y-resolution
-          if (result.format() == 5) {
-            this->LensInfo.FocalPlaneYResolution = result.val_rational()[0];
-          }
-          break;
-
-        case 0xa405:
-          // Focal length in 35mm film
-          if (result.format() == 3)
-            this->FocalLengthIn35mm = result.val_short().front();
-          break;
-
-        case 0xa432:
-          // Focal length and FStop.
-          if (result.format() == 5) {
-            this->LensInfo.FocalLengthMin = result.val_rational()[0];
-            this->LensInfo.FocalLengthMax = result.val_rational()[1];
-            this->LensInfo.FStopMin = result.val_rational()[2];
-            this->LensInfo.FStopMax = result.val_rational()[3];
-          }
-          break;
-
-        case 0xa433:
-          // Lens make.
-          if (result.format() == 2) {
-            this->LensInfo.Make = result.val_string();
-          }
-          break;
-
-        case 0xa434:
-          // Lens model.
-          if (result.format() == 2) {
-            this->LensInfo.Model = result.val_string();
-          }
-          break;
-      }
-      offs += 12;
-    }
+  // typical user might want. The pointer to it is only looked at when any
+  // of its fields was requested.
+  if (state.exif_sub_ifd_offset + 4 <= len) {
+    code = parse_ifd(exif_tags, state, fields, buf, state.exif_sub_ifd_offset,
+                     alignIntel, len);
+    if (code) return code;
   }
 
   // Jump to the GPS SubIFD if it exists and parse all the information
   // there. Note that it's possible that the GPS SubIFD doesn't exist.
-  if (gps_sub_ifd_offset + 4 <= len) {
-    offs = gps_sub_ifd_offset;
-    int num_entries = parse_value<uint16_t>(buf + offs, alignIntel);
-    if (offs + 6 + 12 * num_entries > len) return PARSE_EXIF_ERROR_CORRUPT;
-    offs += 2;
-    while (--num_entries >= 0) {
-      unsigned short tag, format;
-      unsigned length, data;
-      parseIFEntryHeader(buf + offs, alignIntel, tag, format, length, data);
-      switch (tag) {
-        case 1:
-          // GPS north or south
-          this->GeoLocation.LatComponents.direction = *(buf + offs + 8);
-          if (this->GeoLocation.LatComponents.direction == 0) {
-            this->GeoLocation.LatComponents.direction = '?';
-          }
-          if ('S' == this->GeoLocation.LatComponents.direction) {
-            this->GeoLocation.Latitude = -this->GeoLocation.Latitude;
-          }
-          break;
-
-        case 2:
-          // GPS latitude
-          if (format == 5 && length == 3) {
-            this->GeoLocation.LatComponents.degrees = parse_value<Rational>(
-                buf + data + tiff_header_start, alignIntel);
-            this->GeoLocation.LatComponents.minutes = parse_value<Rational>(
-                buf + data + tiff_header_start + 8, alignIntel);
-            this->GeoLocation.LatComponents.seconds = parse_value<Rational>(
-                buf + data + tiff_header_start + 16, alignIntel);
-            this->GeoLocation.Latitude =
-                this->GeoLocation.LatComponents.degrees +
-                this->GeoLocation.LatComponents.minutes / 60 +
-                this->GeoLocation.LatComponents.seconds / 3600;
-            if ('S' == this->GeoLocation.LatComponents.direction) {
-              this->GeoLocation.Latitude = -this->GeoLocation.Latitude;
-            }
-          }
-          break;
-
-        case 3:
-          // GPS east or west
-          this->GeoLocation.LonComponents.direction = *(buf + offs + 8);
-          if (this->GeoLocation.LonComponents.direction == 0) {
-            this->GeoLocation.LonComponents.direction = '?';
-          }
-          if ('W' == this->GeoLocation.LonComponents.direction) {
-            this->GeoLocation.Longitude = -this->GeoLocation.Longitude;
-          }
-          break;
-
-        case 4:
-          // GPS longitude
-          if (format == 5 && length == 3) {
-            this->GeoLocation.LonComponents.degrees = parse_value<Rational>(
-                buf + data + tiff_header_start, alignIntel);
-            this->GeoLocation.LonComponents.minutes = parse_value<Rational>(
-                buf + data + tiff_header_start + 8, alignIntel);
-            this->GeoLocation.LonComponents.seconds = parse_value<Rational>(
-                buf + data + tiff_header_start + 16, alignIntel);
-            this->GeoLocation.Longitude =
-                this->GeoLocation.LonComponents.degrees +
-                this->GeoLocation.LonComponents.minutes / 60 +
-                this->GeoLocation.LonComponents.seconds / 3600;
-            if ('W' == this->GeoLocation.LonComponents.direction)
-              this->GeoLocation.Longitude = -this->GeoLocation.Longitude;
-          }
-          break;
-
-        case 5:
-          // GPS altitude reference (below or above sea level)
-          this->GeoLocation.AltitudeRef = *(buf + offs + 8);
-          if (1 == this->GeoLocation.AltitudeRef) {
-            this->GeoLocation.Altitude = -this->GeoLocation.Altitude;
-          }
-          break;
-
-        case 6:
-          // GPS altitude
-          if (format == 5) {
-            this->GeoLocation.Altitude = parse_value<Rational>(
-                buf + data + tiff_header_start, alignIntel);
-            if (1 == this->GeoLocation.AltitudeRef) {
-              this->GeoLocation.Altitude = -this->GeoLocation.Altitude;
-            }
-          }
-          break;
-
-        case 11:
-          // GPS degree of precision (DOP)
-          if (format == 5) {
-            this->GeoLocation.DOP = parse_value<Rational>(
-                buf + data + tiff_header_start, alignIntel);
-          }
-          break;
-      }
-      offs += 12;
-    }
+  if (state.gps_sub_ifd_offset + 4 <= len) {
+    code = parse_ifd(gps_tags, state, fields, buf, state.gps_sub_ifd_offset,
+                     alignIntel, len);
+    if (code) return code;
   }
 
   return PARSE_EXIF_SUCCESS;
@@ -848,6 +740,8 @@ void easyexif::EXIFInfo::clear() {
   Copyright = "";
 
   // Shorts / unsigned / double
+  TiffOffset = 0;
+  TiffLength = 0;
   ByteAlign = 0;
   Orientation = 0;
 
@@ -890,3 +784,118 @@ void easyexif::EXIFInfo::clear() {
   LensInfo.Make = "";
   LensInfo.Model = "";
 }
+
+std::string easyexif::TagValue::text() const {
+  if (Format != 2 || !Data) return std::string();
+  unsigned length = Count;
+  while (length > 0 && Data[length - 1] == '\0') length--;
+  return std::string(reinterpret_cast<const char *>(Data), length);
+}
+
+double easyexif::TagValue::number(unsigned i) const {
+  if (!Data || i >= Count) return 0;
+  switch (Format) {
+    case 1:
+      return Data[i];
+    case 3:
+      return parse_value<uint16_t>(Data + 2 * i, AlignIntel);
+    case 4:
+    case 13:
+      return parse_value<uint32_t>(Data + 4 * i, AlignIntel);
+    case 9:
+      return static_cast<int32_t>(parse_value<uint32_t>(Data + 4 * i, AlignIntel));
+    case 5:
+      return parse_value<Rational>(Data + 8 * i, AlignIntel);
+    case 10: {
+      int32_t n = parse_value<uint32_t>(Data + 8 * i, AlignIntel);
+      int32_t d = parse_value<uint32_t>(Data + 8 * i + 4, AlignIntel);
+      return d == 0 ? 0.0 : static_cast<double>(n) / d;
+    }
+    default:
+      return 0;
+  }
+}
+
+bool easyexif::TagValue::integer() const {
+  return Format == 1 || Format == 3 || Format == 4 || Format == 9 ||
+         Format == 13;
+}
+
+namespace {
+
+// Searches the directory at 'offs' for 'tag'.
+int find_in_ifd(const unsigned char *buf, unsigned len, uint64_t offs,
+                bool alignIntel, unsigned short tag,
+                easyexif::TagValue &value) {
+  if (offs + 2 > len) return PARSE_EXIF_ERROR_CORRUPT;
+  unsigned num_entries = parse_value<uint16_t>(buf + offs, alignIntel);
+  if (offs + 2 + 12 * static_cast<uint64_t>(num_entries) > len)
+    return PARSE_EXIF_ERROR_CORRUPT;
+  for (unsigned e = 0; e < num_entries; e++) {
+    unsigned entry_offs = offs + 2 + 12 * e;
+    if (parse_value<uint16_t>(buf + entry_offs, alignIntel) != tag) continue;
+
+    IFEntry entry = parseIFEntry(buf, entry_offs, alignIntel, 0, len);
+    if (entry.tag() != tag || !entry.value()) return PARSE_EXIF_ERROR_CORRUPT;
+    value.Format = entry.format();
+    value.Count = entry.length();
+    value.Data = entry.value();
+    value.AlignIntel = alignIntel;
+    return PARSE_EXIF_SUCCESS;
+  }
+  return PARSE_EXIF_ERROR_NO_EXIF;
+}
+
+// Byte order from the TIFF header
+int tiff_byte_order(const unsigned char *buf, unsigned len, bool &alignIntel) {
+  if (!buf || len < 8) return PARSE_EXIF_ERROR_CORRUPT;
+  if (buf[0] == 'I' && buf[1] == 'I')
+    alignIntel = true;
+  else if (buf[0] == 'M' && buf[1] == 'M')
+    alignIntel = false;
+  else
+    return PARSE_EXIF_ERROR_UNKNOWN_BYTEALIGN;
+  if (0x2a != parse_value<uint16_t>(buf + 2, alignIntel))
+    return PARSE_EXIF_ERROR_CORRUPT;
+  return PARSE_EXIF_SUCCESS;
+}
+}
+
+//
+// Single tag lookup in a TIFF block, without decoding any other entry.
+//
+int easyexif::findTag(const unsigned char *buf, unsigned len,
+                      unsigned short tag, TagValue &value) {
+  bool alignIntel = true;
+  int code = tiff_byte_order(buf, len, alignIntel);
+  if (code) return code;
+
+  // IFD0 first, then the EXIF and GPS SubIFDs it points to
+  unsigned ifd0 = parse_value<uint32_t>(buf + 4, alignIntel);
+  code = find_in_ifd(buf, len, ifd0, alignIntel, tag, value);
+  if (code != PARSE_EXIF_ERROR_NO_EXIF) return code;
+
+  static const unsigned short sub_ifd_tags[] = {0x8769, 0x8825};
+  for (unsigned short sub_ifd_tag : sub_ifd_tags) {
+    TagValue pointer;
+    if (find_in_ifd(buf, len, ifd0, alignIntel, sub_ifd_tag, pointer) ||
+        !pointer.integer())
+      continue;
+    code = find_in_ifd(buf, len, static_cast<uint32_t>(pointer.number(0)),
+                       alignIntel, tag, value);
+    if (code != PARSE_EXIF_ERROR_NO_EXIF) return code;
+  }
+  return PARSE_EXIF_ERROR_NO_EXIF;
+}
+
+//
+// Single tag lookup in one directory of a TIFF block.
+//
+int easyexif::findTag(const unsigned char *buf, unsigned len,
+                      unsigned ifd_offset, unsigned short tag,
+                      TagValue &value) {
+  bool alignIntel = true;
+  int code = tiff_byte_order(buf, len, alignIntel);
+  if (code) return code;
+  return find_in_ifd(buf, len, ifd_offset, alignIntel, tag, value);
+}
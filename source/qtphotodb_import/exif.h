@@ -64,24 +64,81 @@ namespace easyexif {
 //
 class EXIFInfo {
  public:
-  // Parsing function for an entire JPEG image buffer.
+  // Fields which can be requested from the parser. Only the requested
+  // fields are decoded, the others keep their default values. When no
+  // field of the EXIF SubIFD or the GPS SubIFD is requested, the whole
+  // sub-directory is skipped.
+  enum Field {
+    // IFD0
+    FIELD_BITS_PER_SAMPLE       = 1u << 0,
+    FIELD_IMAGE_DESCRIPTION     = 1u << 1,
+    FIELD_MAKE                  = 1u << 2,
+    FIELD_MODEL                 = 1u << 3,
+    FIELD_ORIENTATION           = 1u << 4,
+    FIELD_SOFTWARE              = 1u << 5,
+    FIELD_DATE_TIME             = 1u << 6,
+    FIELD_COPYRIGHT             = 1u << 7,
+    // EXIF SubIFD
+    FIELD_EXPOSURE_TIME         = 1u << 8,
+    FIELD_F_NUMBER              = 1u << 9,
+    FIELD_ISO_SPEED_RATINGS     = 1u << 10,
+    FIELD_DATE_TIME_ORIGINAL    = 1u << 11,
+    FIELD_DATE_TIME_DIGITIZED   = 1u << 12,
+    FIELD_SHUTTER_SPEED_VALUE   = 1u << 13,
+    FIELD_EXPOSURE_BIAS_VALUE   = 1u << 14,
+    FIELD_SUBJECT_DISTANCE      = 1u << 15,
+    FIELD_FLASH                 = 1u << 16,
+    FIELD_FOCAL_LENGTH          = 1u << 17,
+    FIELD_METERING_MODE         = 1u << 18,
+    FIELD_SUB_SEC_TIME_ORIGINAL = 1u << 19,
+    FIELD_IMAGE_WIDTH           = 1u << 20,
+    FIELD_IMAGE_HEIGHT          = 1u << 21,
+    FIELD_FOCAL_PLANE_RES       = 1u << 22,
+    FIELD_FOCAL_LENGTH_IN_35MM  = 1u << 23,
+    FIELD_LENS_INFO             = 1u << 24,
+    FIELD_LENS_MAKE             = 1u << 25,
+    FIELD_LENS_MODEL            = 1u << 26,
+    // GPS SubIFD
+    FIELD_GEO_LOCATION          = 1u << 27,
+
+    FIELD_IFD0_MASK             = 0x000000FFu,
+    FIELD_EXIF_MASK             = 0x07FFFF00u,
+    FIELD_GPS_MASK              = 0x08000000u,
+    FIELD_ALL                   = 0x0FFFFFFFu
+  };
+
+  // Parsing function for a JPEG image buffer. Only the segments before the
+  // image data are looked at, so a prefix of the file is enough. TIFF based
+  // files (TIFF, CR2, NEF, ARW, DNG) are parsed with parseFromTIFF(); their
+  // directories may be anywhere in the file, so the whole file has to be in
+  // the buffer (e.g. mapped, only the metadata pages are then read).
   //
-  // PARAM 'data': A pointer to a JPEG image.
-  // PARAM 'length': The length of the JPEG image.
+  // PARAM 'data': A pointer to a JPEG or TIFF image (or its first bytes).
+  // PARAM 'length': The length of the buffer.
+  // PARAM 'fields': The fields to decode (FIELD_* flags).
   // RETURN:  PARSE_EXIF_SUCCESS (0) on succes with 'result' filled out
   //          error code otherwise, as defined by the PARSE_EXIF_ERROR_* macros
-  int parseFrom(const unsigned char *data, unsigned length);
-  int parseFrom(const std::string &data);
+  int parseFrom(const unsigned char *data, unsigned length,
+                unsigned fields = FIELD_ALL);
+  int parseFrom(const std::string &data, unsigned fields = FIELD_ALL);
 
   // Parsing function for an EXIF segment. This is used internally by parseFrom()
   // but can be called for special cases where only the EXIF section is
   // available (i.e., a blob starting with the bytes "Exif\0\0").
-  int parseFromEXIFSegment(const unsigned char *buf, unsigned len);
+  int parseFromEXIFSegment(const unsigned char *buf, unsigned len,
+                           unsigned fields = FIELD_ALL);
+
+  // Parsing function for a TIFF block (i.e., an EXIF segment without the
+  // "Exif\0\0" bytes, a blob starting with "II*\0" or "MM\0*").
+  int parseFromTIFF(const unsigned char *buf, unsigned len,
+                    unsigned fields = FIELD_ALL);
 
   // Set all data members to default values.
   void clear();
 
   // Data fields filled out by parseFrom()
+  unsigned TiffOffset;              // Offset of the TIFF block in the parsed buffer
+  unsigned TiffLength;              // Length of the TIFF block (see parseFromTIFF)
   char ByteAlign;                   // 0 = Motorola byte alignment, 1 = Intel
   std::string ImageDescription;     // Image description
   std::string Make;                 // Camera manufacturer's name
@@ -147,6 +204,38 @@ class EXIFInfo {
   }
 };
 
+//
+// Value of a single tag found by findTag(). The values are not copied, they
+// point into the searched buffer.
+//
+class TagValue {
+ public:
+  unsigned short Format;            // TIFF value format (1 = byte ... 10 = srational, 13 = ifd)
+  unsigned Count;                   // Number of values
+  const unsigned char *Data;        // Values, in the byte order of the block
+  bool AlignIntel;                  // Byte order of the block
+
+  // ASCII value without the terminating zero
+  std::string text() const;
+  // Numeric value 'i' (rationals are divided out), 0 for other formats
+  double number(unsigned i) const;
+  // True for the integer formats (byte, short, long, slong, ifd)
+  bool integer() const;
+};
+
+// Looks up one tag in IFD0, the EXIF SubIFD and the GPS SubIFD (in this
+// order) of a TIFF block, as stored from TiffOffset / TiffLength.
+// RETURN:  PARSE_EXIF_SUCCESS (0) with 'value' filled out if the tag was
+//          found, PARSE_EXIF_ERROR_NO_EXIF if not, other error codes for
+//          blocks which are not valid TIFF
+int findTag(const unsigned char *buf, unsigned len, unsigned short tag,
+            TagValue &value);
+
+// Looks up one tag in the single directory at 'ifdOffset' of a TIFF block,
+// e.g. one of the SubIFDs (0x014A) of a raw file.
+int findTag(const unsigned char *buf, unsigned len, unsigned ifdOffset,
+            unsigned short tag, TagValue &value);
+
 }
 
 // Parse was successful
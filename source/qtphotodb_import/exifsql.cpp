@@ -0,0 +1,120 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifdef EXIFSQL_EXTENSION
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+#else
+#include "stable.h"
+#include <sqlite3.h>
+#endif
+
+#include "exifsql.h"
+#include "exif.h"
+
+static void exifTag(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+  if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || sqlite3_value_type(argv[1]) != SQLITE_INTEGER)
+  {
+    return;
+  }
+
+  const unsigned char *raw = static_cast<const unsigned char*>(sqlite3_value_blob(argv[0]));
+  int length = sqlite3_value_bytes(argv[0]);
+  int tag = sqlite3_value_int(argv[1]);
+  int index = (argc > 2) ? sqlite3_value_int(argv[2]) : 0;
+  if (!raw || tag < 0 || tag > 0xFFFF || index < 0)
+  {
+    return;
+  }
+
+  easyexif::TagValue value;
+  if (easyexif::findTag(raw, length, tag, value) != PARSE_EXIF_SUCCESS)
+  {
+    return;
+  }
+
+  if (value.Format == 2)
+  {
+    std::string text = value.text();
+    sqlite3_result_text(context, text.data(), text.length(), SQLITE_TRANSIENT);
+  }
+  else if (value.Format == 7)
+  {
+    sqlite3_result_blob(context, value.Data, value.Count, SQLITE_TRANSIENT);
+  }
+  else if (static_cast<unsigned>(index) < value.Count)
+  {
+    if (value.integer())
+    {
+      sqlite3_result_int64(context, static_cast<sqlite3_int64>(value.number(index)));
+    }
+    else
+    {
+      sqlite3_result_double(context, value.number(index));
+    }
+  }
+}
+
+int exifSqlRegister(sqlite3 *db)
+{
+  int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
+  int rc = sqlite3_create_function(db, "exif_tag", 2, flags, 0, exifTag, 0, 0);
+  if (rc == SQLITE_OK)
+  {
+    rc = sqlite3_create_function(db, "exif_tag", 3, flags, 0, exifTag, 0, 0);
+  }
+  return rc;
+}
+
+#ifdef EXIFSQL_EXTENSION
+
+// entry point of the loadable extension, e.g. for the sqlite3 shell:
+//   .load libqtphotodb_exifsql
+extern "C" int sqlite3_extension_init(sqlite3 *db, char **errorMessage, const sqlite3_api_routines *api)
+{
+  SQLITE_EXTENSION_INIT2(api);
+  (void)errorMessage;
+  return exifSqlRegister(db);
+}
+
+#else
+
+bool exifSqlAttach(const QSqlDatabase &db)
+{
+  // the functions are registered on the connection of the QSQLITE driver
+  // note: the driver and this tool must use the same sqlite library
+  QVariant handle = db.driver()->handle();
+  if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0)
+  {
+    return false;
+  }
+
+  sqlite3 *connection = *static_cast<sqlite3 **>(handle.data());
+  if (!connection)
+  {
+    return false;
+  }
+
+  return (exifSqlRegister(connection) == SQLITE_OK);
+}
+
+#endif
@@ -0,0 +1,41 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef EXIFSQL_H
+#define EXIFSQL_H
+
+// SQL functions on the raw EXIF blocks stored in Exif.Raw (the TIFF block of
+// the APP1 segment), so new fields can be extracted without the bulk files:
+//   exif_tag(raw, tag)        - value of 'tag' (first value if multi-valued)
+//   exif_tag(raw, tag, index) - value 'index' of a multi-valued tag
+// ASCII tags return text, integer tags integers, rational tags reals and
+// undefined tags blobs; a missing tag or a broken block returns NULL. The
+// functions are deterministic, so they can be used in indexes and
+// generated columns.
+
+struct sqlite3;
+int exifSqlRegister(sqlite3 *db);
+
+#ifndef EXIFSQL_EXTENSION
+bool exifSqlAttach(const QSqlDatabase &db);
+#endif
+
+#endif // EXIFSQL_H
@@ -0,0 +1,233 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "imagesize.h"
+#include "exif.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static unsigned be16(const unsigned char *buf)
+{
+  return (buf[0] << 8) | buf[1];
+}
+
+static unsigned be32(const unsigned char *buf)
+{
+  return (static_cast<unsigned>(buf[0]) << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+static unsigned le16(const unsigned char *buf)
+{
+  return (buf[1] << 8) | buf[0];
+}
+
+static unsigned le32(const unsigned char *buf)
+{
+  return (static_cast<unsigned>(buf[3]) << 24) | (buf[2] << 16) | (buf[1] << 8) | buf[0];
+}
+
+static bool jpegSize(const unsigned char *buf, unsigned len, unsigned &width, unsigned &height)
+{
+  // walk the marker segments to the frame header (SOF0..SOF15 without DHT,
+  // JPG and DAC), which holds the number of lines and samples per line
+  unsigned offs = 2;
+  while (offs + 4 <= len)
+  {
+    if (buf[offs] != 0xFF)
+    {
+      return false;
+    }
+
+    unsigned char marker = buf[offs + 1];
+    if (marker == 0xFF)
+    {
+      // fill byte before a marker
+      offs++;
+      continue;
+    }
+    if (marker == 0x00 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+    {
+      // markers without a length field
+      offs += 2;
+      continue;
+    }
+    if (marker == 0xDA || marker == 0xD9)
+    {
+      // start of scan / end of image without a frame header
+      return false;
+    }
+
+    unsigned length = be16(buf + offs + 2);
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+    {
+      // length, precision, lines, samples per line
+      if (length < 7 || offs + 9 > len)
+      {
+        return false;
+      }
+      height = be16(buf + offs + 5);
+      width  = be16(buf + offs + 7);
+
+      // zero lines: the height is only defined later by a DNL segment
+      return (width > 0 && height > 0);
+    }
+    offs += 2 + length;
+  }
+
+  return false;
+}
+
+static bool pngSize(const unsigned char *buf, unsigned len, unsigned &width, unsigned &height)
+{
+  // signature, then the IHDR chunk: length, type, width, height
+  if (len < 24 || memcmp(buf + 12, "IHDR", 4) != 0)
+  {
+    return false;
+  }
+  width  = be32(buf + 16);
+  height = be32(buf + 20);
+
+  return (width > 0 && height > 0);
+}
+
+static bool bmpSize(const unsigned char *buf, unsigned len, unsigned &width, unsigned &height)
+{
+  // file header (14 bytes), then the size of the info header, which tells
+  // the old OS/2 core header (16 bit values) from the windows headers
+  if (len < 26)
+  {
+    return false;
+  }
+  unsigned header = le32(buf + 14);
+  if (header == 12)
+  {
+    width  = le16(buf + 18);
+    height = le16(buf + 20);
+  }
+  else if (header >= 16)
+  {
+    // the height is negative for top-down bitmaps
+    int w = static_cast<int>(le32(buf + 18));
+    int h = static_cast<int>(le32(buf + 22));
+    if (w <= 0 || h == 0)
+    {
+      return false;
+    }
+    width  = w;
+    height = (h < 0) ? -static_cast<unsigned>(h) : h;
+  }
+  else
+  {
+    return false;
+  }
+
+  return (width > 0 && height > 0);
+}
+
+static bool tiffDirectorySize(const unsigned char *buf, unsigned len, unsigned offset, unsigned &width, unsigned &height)
+{
+  // ImageWidth (0x0100) and ImageLength (0x0101), as short or long
+  easyexif::TagValue w, h;
+  if (easyexif::findTag(buf, len, offset, 0x0100, w) != PARSE_EXIF_SUCCESS ||
+      easyexif::findTag(buf, len, offset, 0x0101, h) != PARSE_EXIF_SUCCESS ||
+      !w.integer() || !h.integer())
+  {
+    return false;
+  }
+  width  = static_cast<unsigned>(w.number(0));
+  height = static_cast<unsigned>(h.number(0));
+
+  return (width > 0 && height > 0);
+}
+
+static bool tiffSize(const unsigned char *buf, unsigned len, unsigned &width, unsigned &height)
+{
+  if (len < 8)
+  {
+    return false;
+  }
+  unsigned ifd0 = (buf[0] == 'I') ? le32(buf + 4) : be32(buf + 4);
+  if (!tiffDirectorySize(buf, len, ifd0, width, height))
+  {
+    return false;
+  }
+
+  // IFD0 of raw files (NEF, DNG, ARW) is often a reduced resolution preview
+  // (NewSubfileType bit 0), the main image is then the largest full
+  // resolution directory in the SubIFDs (0x014A)
+  easyexif::TagValue type, subIfds;
+  if (easyexif::findTag(buf, len, ifd0, 0x00FE, type) != PARSE_EXIF_SUCCESS ||
+      !(static_cast<unsigned>(type.number(0)) & 1) ||
+      easyexif::findTag(buf, len, ifd0, 0x014A, subIfds) != PARSE_EXIF_SUCCESS ||
+      !subIfds.integer())
+  {
+    return true;
+  }
+
+  uint64_t area = 0;
+  for (unsigned i = 0; i < subIfds.Count; i++)
+  {
+    unsigned offset = static_cast<unsigned>(subIfds.number(i));
+    unsigned w, h;
+    if ((easyexif::findTag(buf, len, offset, 0x00FE, type) == PARSE_EXIF_SUCCESS &&
+         (static_cast<unsigned>(type.number(0)) & 1)) ||
+        !tiffDirectorySize(buf, len, offset, w, h))
+    {
+      continue;
+    }
+    if (static_cast<uint64_t>(w) * h > area)
+    {
+      area   = static_cast<uint64_t>(w) * h;
+      width  = w;
+      height = h;
+    }
+  }
+
+  return true;
+}
+
+bool imageSize(const unsigned char *buf, unsigned len, unsigned &width, unsigned &height)
+{
+  if (!buf || len < 4)
+  {
+    return false;
+  }
+
+  if (buf[0] == 0xFF && buf[1] == 0xD8)
+  {
+    return jpegSize(buf, len, width, height);
+  }
+  if (len >= 8 && memcmp(buf, "\x89PNG\r\n\x1a\n", 8) == 0)
+  {
+    return pngSize(buf, len, width, height);
+  }
+  if (buf[0] == 'B' && buf[1] == 'M')
+  {
+    return bmpSize(buf, len, width, height);
+  }
+  if (memcmp(buf, "II*\0", 4) == 0 || memcmp(buf, "MM\0*", 4) == 0)
+  {
+    return tiffSize(buf, len, width, height);
+  }
+
+  return false;
+}
@@ -0,0 +1,35 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef IMAGESIZE_H
+#define IMAGESIZE_H
+
+// Image dimensions from the file header, without decoding any pixels:
+//   JPEG - frame header (SOFn) after the metadata segments
+//   PNG  - IHDR chunk
+//   BMP  - bitmap info header
+//   TIFF - ImageWidth / ImageLength of IFD0
+// 'buf' is the start of the file; JPEG files need the prefix up to the frame
+// header, which follows the APP segments, the other formats a few bytes.
+// RETURN: true if the format was recognized and both dimensions are known
+bool imageSize(const unsigned char *buf, unsigned len, unsigned &width, unsigned &height);
+
+#endif // IMAGESIZE_H
@@ -0,0 +1,232 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "jpegcheck.h"
+
+JpegCheck::JpegCheck()
+  : state(Start),
+    failure(Valid),
+    offset(0),
+    remaining(0),
+    lengthBytes(0),
+    length(0),
+    marker(0),
+    frame(false),
+    scan(false)
+{
+}
+
+JpegCheck::~JpegCheck()
+{
+}
+
+void JpegCheck::addData(const char *data, qint64 size)
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char *end = p + size;
+
+  while (p < end && state != Failed && state != End)
+  {
+    switch (state)
+    {
+      case Start:
+        // SOI, 0xFF 0xD8
+        if (*p != ((offset == 0) ? 0xFF : 0xD8))
+        {
+          fail(NotJpeg);
+          return;
+        }
+        if (offset == 1)
+        {
+          state = Marker;
+        }
+        p++; offset++;
+        break;
+
+      case Marker:
+        // segments follow each other directly
+        if (*p != 0xFF)
+        {
+          fail(Corrupt);
+          return;
+        }
+        state = MarkerType;
+        p++; offset++;
+        break;
+
+      case MarkerType:
+        if (*p == 0xFF)
+        {
+          // fill byte
+        }
+        else if (*p == 0x00 || *p == 0xD8)
+        {
+          fail(Corrupt);
+          return;
+        }
+        else if (*p == 0x01 || (*p >= 0xD0 && *p <= 0xD7))
+        {
+          // markers without a length field
+          state = Marker;
+        }
+        else if (*p == 0xD9)
+        {
+          // EOI before any image data
+          if (!scan)
+          {
+            fail(Corrupt);
+            return;
+          }
+          state = End;
+        }
+        else
+        {
+          beginSegment(*p);
+        }
+        p++; offset++;
+        break;
+
+      case Length:
+        length = (length << 8) | *p;
+        p++; offset++;
+        if (++lengthBytes == 2)
+        {
+          if (length < 2)
+          {
+            fail(Corrupt);
+            return;
+          }
+          remaining = length - 2;
+          state = Segment;
+        }
+        break;
+
+      case Segment:
+      {
+        // the segment payload is skipped as a whole
+        qint64 skip = qMin(remaining, static_cast<qint64>(end - p));
+        p += skip; offset += skip;
+        remaining -= skip;
+        break;
+      }
+
+      case Entropy:
+      {
+        // entropy coded data: only 0xFF bytes are of interest, memchr finds
+        // them a word/vector at a time
+        const void *next = memchr(p, 0xFF, end - p);
+        qint64 skip = next ? (static_cast<const unsigned char*>(next) - p + 1) : (end - p);
+        p += skip; offset += skip;
+        if (next)
+        {
+          state = EntropyMarker;
+        }
+        break;
+      }
+
+      case EntropyMarker:
+        if (*p == 0x00 || (*p >= 0xD0 && *p <= 0xD7))
+        {
+          // stuffed 0xFF data byte or restart marker
+          state = Entropy;
+        }
+        else if (*p == 0xFF)
+        {
+          // fill byte
+        }
+        else if (*p == 0xD9)
+        {
+          state = End;
+        }
+        else if (*p == 0x01 || *p == 0xD8)
+        {
+          fail(Corrupt);
+          return;
+        }
+        else
+        {
+          // tables or the next scan of a progressive image
+          beginSegment(*p);
+        }
+        p++; offset++;
+        break;
+
+      default:
+        return;
+    }
+
+    // segment done: the entropy coded data follows the scan header
+    if (state == Segment && remaining == 0)
+    {
+      state = (marker == 0xDA) ? Entropy : Marker;
+    }
+  }
+}
+
+JpegCheck::Status JpegCheck::status() const
+{
+  if (state == Failed)
+  {
+    return failure;
+  }
+  if (state == End)
+  {
+    return Valid;
+  }
+  return (offset < 2) ? NotJpeg : Truncated;
+}
+
+qint64 JpegCheck::errorOffset() const
+{
+  return offset;
+}
+
+void JpegCheck::fail(Status status)
+{
+  failure = status;
+  state = Failed;
+}
+
+void JpegCheck::beginSegment(unsigned char type)
+{
+  // frame headers (SOFn without DHT, JPG and DAC)
+  if (type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC)
+  {
+    frame = true;
+  }
+
+  // a scan needs a frame
+  if (type == 0xDA)
+  {
+    if (!frame)
+    {
+      fail(Corrupt);
+      return;
+    }
+    scan = true;
+  }
+
+  marker = type;
+  length = 0;
+  lengthBytes = 0;
+  state = Length;
+}
@@ -0,0 +1,59 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef JPEGCHECK_H
+#define JPEGCHECK_H
+
+// Structural JPEG check without decoding: follows the segment chain, scans
+// the entropy coded data for markers and requires the EOI marker. The file
+// is fed in chunks (the hash buffer), so it runs on data already read.
+class JpegCheck
+{
+  public:
+    enum Status { Valid, NotJpeg, Truncated, Corrupt };
+
+    JpegCheck();
+    virtual ~JpegCheck();
+
+    void addData(const char *data, qint64 length);
+
+    Status status() const;
+    qint64 errorOffset() const;
+
+  private:
+    enum State { Start, Marker, MarkerType, Length, Segment, Entropy, EntropyMarker, End, Failed };
+
+    void fail(Status status);
+    void beginSegment(unsigned char type);
+
+  private:
+    State state;
+    Status failure;
+    qint64 offset;
+    qint64 remaining;
+    int lengthBytes;
+    unsigned length;
+    unsigned char marker;
+    bool frame;
+    bool scan;
+};
+
+#endif // JPEGCHECK_H
@@ -0,0 +1,68 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+class LogRecord;
+class Logger
+{
+  public:
+    enum Level { Debug, Info, Warning, Error, Fatal };
+
+    static bool open(const QString &filePath, Level level = Info);
+    static void close();
+    static void flush();
+
+    static void setLevel(Level level);
+    static bool enabled(Level level);
+
+  private:
+    friend class LogRecord;
+    static void enqueue(Level level, const QString &text);
+};
+
+class LogRecord
+{
+  public:
+    LogRecord(Logger::Level level, const QString &message);
+    LogRecord(const LogRecord &other);
+    virtual ~LogRecord();
+
+    LogRecord &field(const char *name, const QString &value);
+    LogRecord &field(const char *name, qint64 value);
+
+  private:
+    LogRecord &operator=(const LogRecord &);
+
+  private:
+    Logger::Level level;
+    QString text;
+    mutable bool active;
+};
+
+inline LogRecord logDebug  (const QString &message) { return LogRecord(Logger::Debug,   message); }
+inline LogRecord logInfo   (const QString &message) { return LogRecord(Logger::Info,    message); }
+inline LogRecord logWarning(const QString &message) { return LogRecord(Logger::Warning, message); }
+inline LogRecord logError  (const QString &message) { return LogRecord(Logger::Error,   message); }
+inline LogRecord logFatal  (const QString &message) { return LogRecord(Logger::Fatal,   message); }
+
+#endif // LOGGER_H
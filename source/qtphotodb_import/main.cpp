@@ -23,18 +23,56 @@
 #include "defines.h"
 #include "options.h"
 #include "exif.h"
+#include "exifsql.h"
+#include "imagesize.h"
+#include "bmff.h"
+#include "jpegcheck.h"
+#include "bulklayout.h"
+#include "sqlprofile.h"
+#include "progress.h"
+#include "logger.h"
+
+// bytes read from the start of a file for the EXIF data (APP segments)
+#define EXIF_PREFIX_SIZE (256 * 1024)
+
+// Photos.Status values (structural check of JPEG files)
+#define PHOTO_STATUS_VALID     0
+#define PHOTO_STATUS_TRUNCATED 1
+#define PHOTO_STATUS_CORRUPT   2
+
+// buffer for hashing the files
+#define HASH_BUFFER_SIZE (1024 * 1024)
+
+// EXIF fields stored in the Exif table
+#define EXIF_IMPORT_FIELDS (easyexif::EXIFInfo::FIELD_IMAGE_DESCRIPTION | \
+                            easyexif::EXIFInfo::FIELD_MAKE              | \
+                            easyexif::EXIFInfo::FIELD_MODEL             | \
+                            easyexif::EXIFInfo::FIELD_SOFTWARE          | \
+                            easyexif::EXIFInfo::FIELD_DATE_TIME         | \
+                            easyexif::EXIFInfo::FIELD_IMAGE_WIDTH       | \
+                            easyexif::EXIFInfo::FIELD_IMAGE_HEIGHT      | \
+                            easyexif::EXIFInfo::FIELD_GEO_LOCATION)
 
 QTextStream cout(stdout, QIODevice::WriteOnly);
 QTextStream cerr(stderr, QIODevice::WriteOnly);
-QTextStream clog;
 
+bool upgradeDatabase();
 bool importFile    (const QString &rootPath,
                     const QString &importPath,
-                    const QString &filePath);
+                    const QString &filePath,
+                    bool quarantine,
+                    const QString &bulkLayout,
+                    bool dedupContent);
 bool importInPhotos(const QString &filePath,
+                    bool    quarantine,
+                    const QString &bulkLayout,
+                    bool    dedupContent,
                     quint32 &photo_id,
                     QString &photo_name,
-                    bool    &photo_dupe);
+                    QString &photo_path,
+                    bool    &photo_dupe,
+                    bool    &photo_shared,
+                    int     &photo_status);
 bool importInExif  (const QString &filePath,
                     const quint32 &photo_id);
 bool importInTags  (const QString &importPath,
@@ -49,8 +87,14 @@ int main(int argc, char *argv[])
   Options options;
 
   bool noLogo = false;
+  bool sqlProfile = false;
+  bool preScan = false;
+  bool showProgress = false;
+  bool quarantine = false;
   QString rootPath;
   QString importPath;
+  QString statusPath;
+  QString dedup;
 
   // set the application info
   app.setApplicationName(APP_NAME);
@@ -59,9 +103,15 @@ int main(int argc, char *argv[])
   app.setApplicationVersion(APP_VERSION);
 
   // add the application options
-  options.add(&rootPath,   "rootPath",              "directory where the db shall be created", true );
-  options.add(&importPath, "importPath", "-i"     , "directory where the db shall be created", true );
-  options.add(&noLogo,     "",           "-nologo", "do not show logo",                        false);
+  options.add(&rootPath,     "rootPath",                   "directory where the db shall be created", true );
+  options.add(&importPath,   "importPath", "-i"          , "directory where the db shall be created", true );
+  options.add(&noLogo,       "",           "-nologo"     , "do not show logo",                        false);
+  options.add(&sqlProfile,   "",           "-sql_profile", "print sql statement statistics at exit",  false);
+  options.add(&preScan,      "",           "-prescan"    , "count files first to estimate the ETA",   false);
+  options.add(&showProgress, "",           "-progress"   , "show a progress line on the terminal",    false);
+  options.add(&statusPath,   "statusFile", "-status"     , "write the progress as json to this file", false);
+  options.add(&quarantine,   "",           "-quarantine" , "put damaged jpegs into quarantine/",      false);
+  options.add(&dedup,        "mode",       "-dedup"      , "find duplicates by exact or content",     false);
 
   // set the application options values
   if (!options.set())
@@ -124,63 +174,299 @@ int main(int argc, char *argv[])
     cerr << "ERROR: Database " << rootPath + "/database.s3db" << " cannot be opened!" << endl;
     return 2;
   }
+  SqlProfile profile;
+  if (sqlProfile && !profile.attach(db))
+  {
+    cerr << "WARNING: SQL profiling not available for this database driver!" << endl;
+  }
+  if (!exifSqlAttach(db))
+  {
+    cerr << "WARNING: EXIF SQL functions not available for this database driver!" << endl;
+  }
   cout << ".done" << endl;
 
   // create a log file
   QDateTime logTime = QDateTime::currentDateTime();
-  QFile logFile(rootPath + "/log/" + QString("%1-%2-%3-%4-%5-%6.import.log")
-                                     .arg(logTime.date().year())
-                                     .arg(logTime.date().month(),  2, 10, QChar('0'))
-                                     .arg(logTime.date().day(),    2, 10, QChar('0'))
-                                     .arg(logTime.time().hour(),   2, 10, QChar('0'))
-                                     .arg(logTime.time().minute(), 2, 10, QChar('0'))
-                                     .arg(logTime.time().second(), 2, 10, QChar('0')));
-  logFile.open(QIODevice::WriteOnly);
-  clog.setDevice(&logFile);
+  Logger::open(rootPath + "/log/" + QString("%1-%2-%3-%4-%5-%6.import.log")
+                                    .arg(logTime.date().year())
+                                    .arg(logTime.date().month(),  2, 10, QChar('0'))
+                                    .arg(logTime.date().day(),    2, 10, QChar('0'))
+                                    .arg(logTime.time().hour(),   2, 10, QChar('0'))
+                                    .arg(logTime.time().minute(), 2, 10, QChar('0'))
+                                    .arg(logTime.time().second(), 2, 10, QChar('0')));
+
+  // bring databases of older versions to the current schema
+  if (!upgradeDatabase())
+  {
+    cerr << "ERROR: Database " << rootPath + "/database.s3db" << " cannot be upgraded!" << endl;
+    Logger::close();
+    return 2;
+  }
+
+  // where new photos are stored in the bulk directory
+  QString bulkLayout;
+  if (!readBulkLayout(db, bulkLayout))
+  {
+    cerr << "ERROR: Bulk layout " << bulkLayout << " is unknown!" << endl;
+    Logger::close();
+    return 2;
+  }
+
+  // how duplicates are found, a mode given once is kept for the archive
+  if (!dedup.isEmpty())
+  {
+    if (!isBulkDedup(dedup))
+    {
+      cerr << "ERROR: Dedup mode " << dedup << " is unknown!" << endl;
+      Logger::close();
+      return 1;
+    }
+    if (!writeSetting(db, "Dedup", dedup))
+    {
+      cerr << "ERROR: Dedup mode cannot be written to the database!" << endl;
+      Logger::close();
+      return 2;
+    }
+    logInfo("dedup written").field("dedup", dedup);
+  }
+  if (!readBulkDedup(db, dedup))
+  {
+    cerr << "ERROR: Dedup mode " << dedup << " is unknown!" << endl;
+    Logger::close();
+    return 2;
+  }
+  bool dedupContent = (dedup == "content");
+
+  QStringList filter;
+  filter << "*.jpg" << "*.jpeg" << "*.png" << "*.bmp" << "*.tiff" << "*.tif"
+         << "*.cr2" << "*.nef" << "*.arw" << "*.dng"
+         << "*.heic" << "*.heif" << "*.mp4" << "*.mov";
+
+  Progress progress(cout);
+  progress.setStatusFile(statusPath);
+  progress.setTerminal(showProgress);
+
+  // count the files to be imported (directory entries only, no content)
+  if (preScan)
+  {
+    progress.setStage("scanning");
+    qint64 totalFiles = 0, totalBytes = 0;
+    QDirIterator it(importPath, filter, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+      it.next();
+      totalFiles++;
+      totalBytes += it.fileInfo().size();
+    }
+    progress.setTotal(totalFiles, totalBytes);
+  }
 
   // parse the import path for pictures
-  cout << "Importing photos";
-  QStringList filter; int cnt = 0;
-  filter << "*.jpg" << "*.jpeg" << "*.png" << "*.bmp" << "*.tiff";
+  cout << "Importing photos" << endl;
+  progress.setStage("importing");
   QDirIterator it(importPath, filter, QDir::Files, QDirIterator::Subdirectories);
   while (it.hasNext())
   {
     QString filePath = it.next();
-    importFile(rootPath, importPath, filePath);
-    cnt++; cout << "."; cout.flush(); if (cnt % 50 == 0) cout << cnt << endl;
+    importFile(rootPath, importPath, filePath, quarantine, bulkLayout, dedupContent);
+    progress.update(it.fileInfo().size());
+  }
+  progress.finish();
+  cout << progress.summary() << endl;
+
+  if (sqlProfile)
+  {
+    cout << endl << profile.report(20);
   }
-  cout << cnt << " done." << endl;
 
-  logFile.close();
+  Logger::close();
   return 0;
 }
 
-bool importFile(const QString &rootPath, const QString &importPath, const QString &filePath)
+bool upgradeDatabase()
+{
+  QSqlQuery q(QSqlDatabase::database());
+
+  // Exif.Raw: the raw EXIF block of each photo
+  if (!QSqlDatabase::database().record("Exif").contains("Raw"))
+  {
+    if (!q.exec("ALTER TABLE Exif ADD COLUMN [Raw] BLOB NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Exif").field("sql", q.lastQuery());
+  }
+
+  // Photos.Status: result of the structural check of JPEG files
+  if (!QSqlDatabase::database().record("Photos").contains("Status"))
+  {
+    if (!q.exec("ALTER TABLE Photos ADD COLUMN [Status] INTEGER DEFAULT 0 NOT NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Photos").field("sql", q.lastQuery());
+  }
+
+  // Exif.Duration: the length of video clips
+  if (!QSqlDatabase::database().record("Exif").contains("Duration"))
+  {
+    if (!q.exec("ALTER TABLE Exif ADD COLUMN [Duration] FLOAT NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Exif").field("sql", q.lastQuery());
+  }
+
+  // Photos.Path: the path of the photo in the bulk directory, see bulklayout.h
+  if (!QSqlDatabase::database().record("Photos").contains("Path"))
+  {
+    if (!q.exec("ALTER TABLE Photos ADD COLUMN [Path] VARCHAR(1024) NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Photos").field("sql", q.lastQuery());
+  }
+
+  // Settings: options of the archive, e.g. BulkLayout
+  if (!QSqlDatabase::database().tables().contains("Settings"))
+  {
+    if (!q.exec("CREATE TABLE [Settings] ([Name] VARCHAR(32) PRIMARY KEY NOT NULL, [Value] VARCHAR(1024) NULL)"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Settings").field("sql", q.lastQuery());
+  }
+
+  // ChangeLog / Views: the photos changed since the last qtphotodb_symlnk run
+  if (!QSqlDatabase::database().tables().contains("ChangeLog"))
+  {
+    QStringList sql;
+    sql << "CREATE TABLE [ChangeLog] ([Seq] INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, [PhotoId] INTEGER NOT NULL)"
+        << "CREATE TABLE IF NOT EXISTS [Views] ([Name] VARCHAR(32) PRIMARY KEY NOT NULL, [Watermark] INTEGER NOT NULL, [LinkType] VARCHAR(16) DEFAULT 'symlink' NOT NULL)";
+
+    QStringList tables = QStringList() << "Photos" << "Tags" << "Albums" << "Exif";
+    for (int i = 0; i < tables.count(); i++)
+    {
+      QString photoId = (tables[i] == "Photos") ? "Id" : "PhotoId";
+      sql << QString("CREATE TRIGGER IF NOT EXISTS [%1Insert] AFTER INSERT ON [%1] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.%2); END").arg(tables[i]).arg(photoId)
+          << QString("CREATE TRIGGER IF NOT EXISTS [%1Update] AFTER UPDATE ON [%1] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (NEW.%2); END").arg(tables[i]).arg(photoId)
+          << QString("CREATE TRIGGER IF NOT EXISTS [%1Delete] AFTER DELETE ON [%1] BEGIN INSERT INTO ChangeLog (PhotoId) VALUES (OLD.%2); END").arg(tables[i]).arg(photoId);
+      if (tables[i] != "Photos")
+      {
+        sql << QString("CREATE INDEX IF NOT EXISTS [%1PhotoId] ON [%1] (PhotoId)").arg(tables[i]);
+      }
+    }
+
+    for (int i = 0; i < sql.count(); i++)
+    {
+      if (!q.exec(sql[i]))
+      {
+        logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+        return false;
+      }
+    }
+    logInfo("table upgraded").field("table", "ChangeLog").field("sql", sql.join("; "));
+  }
+
+  // Photos.ObjectId / Photos.Refs: photos sharing the file of another photo
+  // (Dedup=content); the owner of a file cannot be deleted while shared and
+  // the photos sharing it are logged when it is moved. The other tools only
+  // add Photos.ObjectId to read the shared paths
+  if (!QSqlDatabase::database().record("Photos").contains("Refs"))
+  {
+    QStringList sql;
+    if (!QSqlDatabase::database().record("Photos").contains("ObjectId"))
+    {
+      sql << "ALTER TABLE Photos ADD COLUMN [ObjectId] INTEGER NULL";
+    }
+    sql << "ALTER TABLE Photos ADD COLUMN [Refs] INTEGER DEFAULT 0 NOT NULL"
+        << "CREATE INDEX IF NOT EXISTS [PhotosObjectId] ON [Photos] (ObjectId)"
+        << "CREATE TRIGGER IF NOT EXISTS [PhotosRefsInsert] AFTER INSERT ON [Photos] WHEN NEW.ObjectId IS NOT NULL BEGIN UPDATE Photos SET Refs = Refs + 1 WHERE Id = NEW.ObjectId; END"
+        << "CREATE TRIGGER IF NOT EXISTS [PhotosRefsDelete] AFTER DELETE ON [Photos] WHEN OLD.ObjectId IS NOT NULL BEGIN UPDATE Photos SET Refs = Refs - 1 WHERE Id = OLD.ObjectId; END"
+        << "CREATE TRIGGER IF NOT EXISTS [PhotosRefsShared] BEFORE DELETE ON [Photos] WHEN OLD.Refs > 0 BEGIN SELECT RAISE(ABORT, 'photo file is shared'); END"
+        << "CREATE TRIGGER IF NOT EXISTS [PhotosRefsMove] AFTER UPDATE OF Path ON [Photos] WHEN NEW.Refs > 0 BEGIN INSERT INTO ChangeLog (PhotoId) SELECT Id FROM Photos WHERE ObjectId = NEW.Id; END";
+
+    for (int i = 0; i < sql.count(); i++)
+    {
+      if (!q.exec(sql[i]))
+      {
+        logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+        return false;
+      }
+    }
+    logInfo("table upgraded").field("table", "Photos").field("sql", sql.join("; "));
+  }
+
+  // Photos.Hash: duplicates are looked up by hash on every import
+  if (!q.exec("CREATE INDEX IF NOT EXISTS [PhotosHash] ON [Photos] (Hash)"))
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
+  }
+
+  return true;
+}
+
+bool importFile(const QString &rootPath, const QString &importPath, const QString &filePath, bool quarantine, const QString &bulkLayout, bool dedupContent)
 {
-  quint32   photo_id   = 0;
-  QString   photo_name = "";
-  bool      photo_dupe = false;
+  quint32   photo_id     = 0;
+  QString   photo_name   = "";
+  QString   photo_path   = "";
+  bool      photo_dupe   = false;
+  bool      photo_shared = false;
+  int       photo_status = PHOTO_STATUS_VALID;
 
   // start transaction for one photo import
   QSqlDatabase::database().transaction();
 
   // import all photo details into the database - rollback if it does not work
-  if (!importInPhotos(filePath, photo_id, photo_name, photo_dupe))
+  if (!importInPhotos(filePath, quarantine, bulkLayout, dedupContent, photo_id, photo_name, photo_path, photo_dupe, photo_shared, photo_status))
   {
      QSqlDatabase::database().rollback();
      return false;
   }
 
+  // damaged files are kept out of the archive, they are copied to the
+  // quarantine directory with their import path instead
+  if (quarantine && photo_status != PHOTO_STATUS_VALID)
+  {
+    QSqlDatabase::database().rollback();
+    QString quarantinePath = rootPath + "/quarantine/" + QDir(importPath).dirName() + filePath.mid(importPath.length());
+    QDir().mkpath(QFileInfo(quarantinePath).absolutePath());
+    QFile::remove(quarantinePath);
+    if (!QFile::copy(filePath, quarantinePath))
+    {
+      logError("file cannot be copied").field("file", filePath);
+      return false;
+    }
+    logWarning("quarantined").field("status", photo_status).field("file", filePath);
+    return false;
+  }
+
+  // a photo sharing the file of another one only gets its exif data
+  if (photo_shared)
+  {
+    logInfo("shared").field("name", photo_name).field("file", filePath);
+    importInExif(filePath, photo_id);
+  }
+
   // copy photo to bulk directory - rollback if it does not work
-  if (!photo_dupe)
+  else if (!photo_dupe)
   {
-    if (!QFile::copy(filePath, rootPath + "/bulk/" + photo_name))
+    QString bulkFilePath = rootPath + "/bulk/" + photo_path;
+    QDir().mkpath(QFileInfo(bulkFilePath).absolutePath());
+    if (!QFile::copy(filePath, bulkFilePath))
     {
       QSqlDatabase::database().rollback();
-      cerr << "ERROR: File " << filePath << " cannot be copied!" << endl;
+      logError("file cannot be copied").field("file", filePath);
       return false;
     }
-    clog << photo_name << " : " << filePath << endl;
+    logInfo("imported").field("name", photo_name).field("file", filePath);
 
     // store exif data into the database
     importInExif(filePath, photo_id);
@@ -198,25 +484,54 @@ bool importFile(const QString &rootPath, const QString &importPath, const QStrin
   return true;
 }
 
-bool importInPhotos(const QString &filePath, quint32 &photo_id, QString &photo_name, bool &photo_dupe)
+bool importInPhotos(const QString &filePath, bool quarantine, const QString &bulkLayout, bool dedupContent, quint32 &photo_id, QString &photo_name, QString &photo_path, bool &photo_dupe, bool &photo_shared, int &photo_status)
 {
   QFile file(filePath);
 
   if (!file.open(QIODevice::ReadOnly))
   {
-    cerr << "ERROR: " << filePath << " cannot be opened!" << endl;
+    logError("file cannot be opened").field("file", filePath);
     return false;
   }
 
-  // make a MD5 hash of the picture to be able to compare
+  // make a MD5 hash of the picture to be able to compare, streamed through
+  // a fixed buffer so large video files do not have to fit into memory; the
+  // structure of JPEG files is checked on the same buffer
   QCryptographicHash hash(QCryptographicHash::Md5);
-  hash.addData(file.readAll());
+  JpegCheck check;
+  static char buffer[HASH_BUFFER_SIZE];
+  qint64 length;
+  while ((length = file.read(buffer, sizeof(buffer))) > 0)
+  {
+    hash.addData(buffer, length);
+    check.addData(buffer, length);
+  }
   file.close();
+  if (length < 0)
+  {
+    logError("file cannot be read").field("file", filePath);
+    return false;
+  }
+
+  switch (check.status())
+  {
+    case JpegCheck::Truncated: photo_status = PHOTO_STATUS_TRUNCATED; break;
+    case JpegCheck::Corrupt:   photo_status = PHOTO_STATUS_CORRUPT;   break;
+    default:                   photo_status = PHOTO_STATUS_VALID;     break;
+  }
+  if (photo_status != PHOTO_STATUS_VALID)
+  {
+    logWarning("invalid jpeg").field("status", photo_status).field("offset", check.errorOffset()).field("file", filePath);
+    if (quarantine)
+    {
+      return true;
+    }
+  }
 
   QSqlQuery q(QSqlDatabase::database());
   if (!q.exec("SELECT max(Photos.Id) FROM Photos"))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
 
@@ -235,7 +550,7 @@ bool importInPhotos(const QString &filePath, quint32 &photo_id, QString &photo_n
   // check for same size/hash
   if (!q.prepare("SELECT Photos.Id,Photos.Name FROM Photos WHERE Photos.Hash=? AND Photos.Size=? AND Photos.Date=?"))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
   q.bindValue(0, photo_hash);
@@ -243,7 +558,7 @@ bool importInPhotos(const QString &filePath, quint32 &photo_id, QString &photo_n
   q.bindValue(2, photo_date);
   if (!q.exec())
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
 
@@ -253,15 +568,40 @@ bool importInPhotos(const QString &filePath, quint32 &photo_id, QString &photo_n
     photo_dupe = true;
     photo_id   = q.value(0).toUInt();
     photo_name = q.value(1).toString();
-    clog << photo_name << " [dupe]: " << filePath << endl;
+    logInfo("dupe").field("name", photo_name).field("file", filePath);
     return true;
   }
-
-  // insert the photo in the database
   photo_dupe = false;
-  if (!q.prepare("INSERT INTO Photos (Id,Name,Hash,Size,Date) VALUES(?,?,?,?,?)"))
+
+  // by content the same photo with another date gets its own row, which
+  // references the photo owning the file in bulk/
+  QVariant object_id(QVariant::UInt);
+  if (dedupContent)
+  {
+    if (!q.prepare("SELECT ifnull(Photos.ObjectId,Photos.Id) FROM Photos WHERE Photos.Hash=? LIMIT 1"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    q.bindValue(0, photo_hash);
+    if (!q.exec())
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    if (q.next())
+    {
+      object_id = q.value(0);
+    }
+  }
+  photo_shared = !object_id.isNull();
+
+  // insert the photo in the database, the path is only kept for layouts
+  // other than flat and for photos owning their file
+  photo_path = photo_shared ? QString() : bulkPath(bulkLayout, photo_name, photo_hash, photo_date);
+  if (!q.prepare("INSERT INTO Photos (Id,Name,Hash,Size,Date,Status,Path,ObjectId) VALUES(?,?,?,?,?,?,?,?)"))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
   q.bindValue(0, photo_id);
@@ -269,9 +609,12 @@ bool importInPhotos(const QString &filePath, quint32 &photo_id, QString &photo_n
   q.bindValue(2, photo_hash);
   q.bindValue(3, photo_size);
   q.bindValue(4, photo_date);
+  q.bindValue(5, photo_status);
+  q.bindValue(6, (photo_shared || photo_path == photo_name) ? QVariant(QVariant::String) : QVariant(photo_path));
+  q.bindValue(7, object_id);
   if (!q.exec())
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
 
@@ -280,53 +623,118 @@ bool importInPhotos(const QString &filePath, quint32 &photo_id, QString &photo_n
 
 bool importInExif(const QString &filePath, const quint32 &photo_id)
 {
-  // Read the JPEG file into a buffer
-  FILE *fp = fopen(filePath.toStdString().c_str(), "rb");
-  if (!fp) {
-    clog << "EXIF ERROR [open]: " << filePath << endl;
+  // Read the start of the file into a buffer, the metadata segments and
+  // image headers are all in front of the image data
+  QFile file(filePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    logWarning("exif open failed").field("file", filePath);
     return false;
   }
-  fseek(fp, 0, SEEK_END);
-  unsigned long fsize = ftell(fp);
-  rewind(fp);
-  unsigned char *buf = new unsigned char[fsize];
-  if (fread(buf, 1, fsize, fp) != fsize) {
-    clog << "EXIF ERROR [read]: " << filePath << endl;
-    delete[] buf;
+  static unsigned char prefix[EXIF_PREFIX_SIZE];
+  qint64 fsize = file.read(reinterpret_cast<char*>(prefix), sizeof(prefix));
+  if (fsize < 0) {
+    logWarning("exif read failed").field("file", filePath);
     return false;
   }
-  fclose(fp);
 
-  // Parse EXIF
-  easyexif::EXIFInfo result;
-  int code = result.parseFrom(buf, fsize);
-  delete[] buf;
+  // TIFF based files (TIFF, CR2, NEF, ARW, DNG) and ISO media files (HEIC,
+  // MP4, MOV) can keep their metadata anywhere in the file: larger ones are
+  // mapped, so only the pages the parsers touch are read from disk
+  const unsigned char *buf = prefix;
+  bool tiff = (fsize >= 4 && (memcmp(prefix, "II*\0", 4) == 0 || memcmp(prefix, "MM\0*", 4) == 0));
+  bool bmff = isBmff(prefix, fsize);
+  if ((bmff || (tiff && file.size() <= Q_INT64_C(0xFFFFFFFF))) && fsize == sizeof(prefix)) {
+    const uchar *map = file.map(0, file.size());
+    if (map) {
+      buf = map;
+      fsize = file.size();
+    }
+  }
+
+  // Parse EXIF (the parser object is reused, its strings keep their capacity)
+  // and take the dimensions from the image header, so photos without EXIF
+  // data (PNG, BMP, JPEG without APP1...) still have a size; the EXIF values
+  // are only used for formats the probe does not know. The raw EXIF block is
+  // kept for JPEG and HEIF only, a TIFF file is a TIFF block as a whole.
+  static easyexif::EXIFInfo result;
+  int code;
+  bool sized;
+  unsigned width = 0, height = 0;
+  double duration = 0;
+  const unsigned char *raw = 0;
+  unsigned rawLength = 0;
+  if (bmff) {
+    // box headers only, the EXIF data of HEIF images is a TIFF block item
+    BmffInfo media;
+    sized = parseBmff(buf, fsize, media) && media.width > 0 && media.height > 0;
+    width = media.width;
+    height = media.height;
+    duration = media.duration;
+    result.clear();
+    code = PARSE_EXIF_ERROR_NO_EXIF;
+    if (media.exifLength > 0 && media.exifLength <= Q_UINT64_C(0xFFFFFFFF)) {
+      code = result.parseFromTIFF(buf + media.exifOffset, media.exifLength, EXIF_IMPORT_FIELDS);
+      raw = buf + media.exifOffset;
+      rawLength = media.exifLength;
+    }
+  } else {
+    code = result.parseFrom(buf, fsize, EXIF_IMPORT_FIELDS);
+    sized = imageSize(buf, fsize, width, height);
+    if (!tiff) {
+      raw = buf + result.TiffOffset;
+      rawLength = result.TiffLength;
+    }
+  }
   if (code) {
-    clog << "EXIF ERROR [" << code << "]:" << filePath << endl;
+    logWarning("exif parse failed").field("code", code).field("file", filePath);
+  }
+  if (!sized && !code) {
+    width = result.ImageWidth;
+    height = result.ImageHeight;
+  }
+  if (code && !sized) {
     return false;
   }
 
   QSqlQuery q(QSqlDatabase::database());
-  if (!q.prepare("INSERT INTO Exif (ImageDescription,Make,Model,Software,DateTime,ImageWidth,ImageHeight,Latitude,Longitude,Altitude,PhotoId)"
-                 "VALUES(?,?,?,?,?,?,?,?,?,?,?)"))
+  if (!q.prepare("INSERT INTO Exif (ImageDescription,Make,Model,Software,DateTime,ImageWidth,ImageHeight,Latitude,Longitude,Altitude,Raw,Duration,PhotoId)"
+                 "VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?)"))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
-  q.bindValue(0,  result.ImageDescription.c_str());
-  q.bindValue(1,  result.Make.c_str());
-  q.bindValue(2,  result.Model.c_str());
-  q.bindValue(3,  result.Software.c_str());
-  q.bindValue(4,  result.DateTime.c_str());
-  q.bindValue(5,  result.ImageWidth);
-  q.bindValue(6,  result.ImageHeight);
-  q.bindValue(7,  result.GeoLocation.Latitude);
-  q.bindValue(8,  result.GeoLocation.Longitude);
-  q.bindValue(9,  result.GeoLocation.Altitude);
-  q.bindValue(10, photo_id);
+  if (code)
+  {
+    // only the dimensions are known
+    q.bindValue(0,  QVariant());
+    q.bindValue(1,  QVariant());
+    q.bindValue(2,  QVariant());
+    q.bindValue(3,  QVariant());
+    q.bindValue(4,  QVariant());
+    q.bindValue(7,  QVariant());
+    q.bindValue(8,  QVariant());
+    q.bindValue(9,  QVariant());
+    q.bindValue(10, QVariant());
+  }
+  else
+  {
+    q.bindValue(0,  result.ImageDescription.c_str());
+    q.bindValue(1,  result.Make.c_str());
+    q.bindValue(2,  result.Model.c_str());
+    q.bindValue(3,  result.Software.c_str());
+    q.bindValue(4,  result.DateTime.c_str());
+    q.bindValue(7,  result.GeoLocation.Latitude);
+    q.bindValue(8,  result.GeoLocation.Longitude);
+    q.bindValue(9,  result.GeoLocation.Altitude);
+    q.bindValue(10, raw ? QByteArray(reinterpret_cast<const char*>(raw), rawLength) : QVariant());
+  }
+  q.bindValue(5,  width);
+  q.bindValue(6,  height);
+  q.bindValue(11, duration > 0 ? QVariant(duration) : QVariant());
+  q.bindValue(12, photo_id);
   if (!q.exec())
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
 
@@ -353,7 +761,7 @@ bool importInTags(const QString &importPath, const QString &filePath, const quin
   QStringList tags;
   if (!q.prepare("SELECT Tags.Name,Tags.PhotoId FROM Tags WHERE Tags.Name=? AND Tags.PhotoId=?"))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
   for (int i = 0; i < labels.count(); i++)
@@ -362,7 +770,7 @@ bool importInTags(const QString &importPath, const QString &filePath, const quin
     q.bindValue(1, photo_id);
     if (!q.exec())
     {
-      cerr << "ERROR: " << q.lastError().text() << endl;
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
       return false;
     }
     if (!q.next())
@@ -373,7 +781,7 @@ bool importInTags(const QString &importPath, const QString &filePath, const quin
 
   if (!q.prepare("INSERT INTO Tags (Name,PhotoId) VALUES(?,?)"))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
   for (int i = 0; i < tags.count(); i++)
@@ -382,7 +790,7 @@ bool importInTags(const QString &importPath, const QString &filePath, const quin
     q.bindValue(1, photo_id);
     if (!q.exec())
     {
-      cerr << "ERROR: " << q.lastError().text() << endl;
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
       return false;
     }
   }
@@ -398,14 +806,14 @@ bool importInAlbums(const QString &importPath, const quint32 &photo_id)
   // check for same album/photoID
   if (!q.prepare("SELECT Albums.Name,Albums.PhotoId FROM Albums WHERE Albums.Name=? AND Albums.PhotoId=?"))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
   q.bindValue(0, album);
   q.bindValue(1, photo_id);
   if (!q.exec())
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
   if (q.next())
@@ -415,14 +823,14 @@ bool importInAlbums(const QString &importPath, const quint32 &photo_id)
 
   if (!q.prepare("INSERT INTO Albums (Name,PhotoId) VALUES(?,?)"))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
   q.bindValue(0, album);
   q.bindValue(1, photo_id);
   if (!q.exec())
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
 
@@ -0,0 +1,201 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "progress.h"
+
+// minimum time between two reports (status file or terminal line)
+#define PROGRESS_INTERVAL_MS      1000
+// minimum time between two plain lines when not on a terminal (journal)
+#define PROGRESS_LINE_INTERVAL_MS 10000
+
+Progress::Progress(QTextStream &out) : out(out)
+{
+  terminal   = false;
+  totalFiles = totalBytes = 0;
+  files      = bytes      = 0;
+  lastReport = lastLine   = 0;
+  timer.start();
+}
+
+Progress::~Progress()
+{
+}
+
+void Progress::setStatusFile(const QString &filePath)
+{
+  statusFilePath = filePath;
+}
+
+void Progress::setTerminal(bool enabled)
+{
+  terminal = enabled;
+}
+
+void Progress::setTotal(qint64 files, qint64 bytes)
+{
+  totalFiles = files;
+  totalBytes = bytes;
+}
+
+void Progress::setStage(const QString &name)
+{
+  // the rates, the ETA and the summary are measured from the start of the
+  // stage, a pre-scan does not count against the import
+  stage = name;
+  lastReport = lastLine = 0;
+  timer.restart();
+  report(true);
+}
+
+void Progress::update(qint64 size)
+{
+  files++;
+  bytes += size;
+
+  // cheap check against the monotonic clock, nothing is written in between
+  if (timer.elapsed() - lastReport >= PROGRESS_INTERVAL_MS)
+  {
+    report(false);
+  }
+}
+
+void Progress::finish()
+{
+  stage = "done";
+  report(true);
+  if (terminal)
+  {
+    out << endl;
+  }
+}
+
+QString Progress::summary() const
+{
+  qint64 elapsed = timer.elapsed();
+  double seconds = qMax<qint64>(elapsed, 1) / 1000.0;
+
+  return QString("%1 files, %2 MB in %3 s (%4 files/s, %5 MB/s)")
+         .arg(files)
+         .arg(bytes / 1048576.0,            0, 'f', 1)
+         .arg(seconds,                      0, 'f', 1)
+         .arg(files / seconds,              0, 'f', 1)
+         .arg(bytes / 1048576.0 / seconds,  0, 'f', 1);
+}
+
+void Progress::report(bool force)
+{
+  qint64 elapsed = timer.elapsed();
+  lastReport = elapsed;
+
+  if (!statusFilePath.isEmpty())
+  {
+    writeStatus(elapsed);
+  }
+
+  if (terminal)
+  {
+    // overwrite the same terminal line
+    out << "\r" << line(elapsed) << "\033[K";
+    out.flush();
+  }
+  else if (force || elapsed - lastLine >= PROGRESS_LINE_INTERVAL_MS)
+  {
+    lastLine = elapsed;
+    out << line(elapsed) << endl;
+  }
+}
+
+void Progress::writeStatus(qint64 elapsed)
+{
+  double seconds = qMax<qint64>(elapsed, 1) / 1000.0;
+
+  QJsonObject status;
+  status["stage"]        = stage;
+  status["files"]        = files;
+  status["bytes"]        = bytes;
+  status["total_files"]  = totalFiles;
+  status["total_bytes"]  = totalBytes;
+  status["elapsed"]      = seconds;
+  status["files_per_s"]  = files / seconds;
+  status["bytes_per_s"]  = bytes / seconds;
+  status["eta"]          = eta(elapsed);
+  status["updated"]      = QDateTime::currentDateTime().toString(Qt::ISODate);
+  status["pid"]          = QCoreApplication::applicationPid();
+
+  // QSaveFile writes a temporary file and renames it over the old one, so
+  // a monitoring process never reads a half written status
+  QSaveFile statusFile(statusFilePath);
+  if (statusFile.open(QIODevice::WriteOnly))
+  {
+    statusFile.write(QJsonDocument(status).toJson(QJsonDocument::Compact));
+    statusFile.write("\n");
+    statusFile.commit();
+  }
+}
+
+QString Progress::line(qint64 elapsed) const
+{
+  double seconds = qMax<qint64>(elapsed, 1) / 1000.0;
+
+  QString text = QString("%1: %2").arg(stage).arg(files);
+  if (totalFiles > 0)
+  {
+    text += QString("/%1 (%2%)").arg(totalFiles).arg(100.0 * files / totalFiles, 0, 'f', 1);
+  }
+  text += QString(" files, %1 files/s, %2 MB/s")
+          .arg(files / seconds,              0, 'f', 1)
+          .arg(bytes / 1048576.0 / seconds,  0, 'f', 1);
+
+  qint64 remaining = eta(elapsed);
+  if (remaining >= 0)
+  {
+    // QTime wraps at 24 h, long imports show the hours in full
+    text += QString(", ETA %1:%2:%3")
+            .arg(remaining / 3600,      2, 10, QChar('0'))
+            .arg(remaining / 60 % 60,   2, 10, QChar('0'))
+            .arg(remaining % 60,        2, 10, QChar('0'));
+  }
+
+  return text;
+}
+
+qint64 Progress::eta(qint64 elapsed) const
+{
+  if (elapsed <= 0)
+  {
+    return -1;
+  }
+
+  // the byte rate is a better predictor than the file rate (copy bound);
+  // the ratio is taken in double, the product overflows for TB imports
+  if (totalBytes > 0 && bytes > 0)
+  {
+    return qMax<qint64>(0, qint64((totalBytes - bytes) * (double(elapsed) / bytes) / 1000));
+  }
+  if (totalFiles > 0 && files > 0)
+  {
+    return qMax<qint64>(0, qint64((totalFiles - files) * (double(elapsed) / files) / 1000));
+  }
+
+  // without a pre-scan there is nothing to estimate against
+  return -1;
+}
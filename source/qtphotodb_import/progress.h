@@ -0,0 +1,58 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+class Progress
+{
+  public:
+    Progress(QTextStream &out);
+    virtual ~Progress();
+
+    void setStatusFile(const QString &filePath);
+    void setTerminal(bool enabled);
+    void setTotal(qint64 files, qint64 bytes);
+    void setStage(const QString &name);
+
+    void update(qint64 size);
+    void finish();
+
+    QString summary() const;
+
+  private:
+    void report(bool force);
+    void writeStatus(qint64 elapsed);
+    QString line(qint64 elapsed) const;
+    qint64 eta(qint64 elapsed) const;
+
+  private:
+    QTextStream &out;
+    QString statusFilePath;
+    QString stage;
+    bool terminal;
+    qint64 totalFiles, totalBytes;
+    qint64 files, bytes;
+    qint64 lastReport, lastLine;
+    QElapsedTimer timer;
+};
+
+#endif // PROGRESS_H
@@ -0,0 +1,391 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "defines.h"
+#include "options.h"
+#include "../qtphotodb_import/bulklayout.h"
+#include "logger.h"
+
+// photos moved per transaction
+#define MIGRATE_BATCH_SIZE 1000
+
+QTextStream cout(stdout, QIODevice::WriteOnly);
+QTextStream cerr(stderr, QIODevice::WriteOnly);
+
+struct MigrateStats
+{
+  int photos;
+  int moved;
+  int resumed;
+  int failed;
+};
+
+bool upgradeDatabase();
+bool writeLayout    (const QString &layout);
+bool migrateBatch   (const QString &bulkDirPath,
+                     const QString &layout,
+                     int batchSize,
+                     quint32 &lastId,
+                     bool &done,
+                     MigrateStats &stats);
+int  removeEmptyDirs(const QString &bulkPath);
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  Options options;
+
+  bool noLogo = false;
+  QString rootPath;
+  QString layout;
+  QString batch;
+
+  // set the application info
+  app.setApplicationName(APP_NAME);
+  app.setOrganizationName(APP_COMPANY);
+  app.setOrganizationDomain(APP_DOMAIN);
+  app.setApplicationVersion(APP_VERSION);
+
+  // add the application options
+  options.add(&rootPath, "rootPath",                 "directory of the db",                   true );
+  options.add(&layout,   "layout",    "-layout"    , "bulk layout: flat, date or hash",       true );
+  options.add(&batch,    "count",     "-batch"     , "photos moved per transaction",          false);
+  options.add(&noLogo,   "",          "-nologo"    , "do not show logo",                      false);
+
+  // set the application options values
+  if (!options.set())
+  {
+    cout << options.logo()  << endl;
+    cout << options.usage() << endl;
+    return 1;
+  }
+  else if (!noLogo)
+  {
+    // print copyright logo
+    cout << options.logo() << endl;
+  }
+
+  cout << "Initial check";
+  // check the requested layout
+  if (!isBulkLayout(layout))
+  {
+    cerr << "ERROR: Bulk layout " << layout << " is unknown!" << endl;
+    return 1;
+  }
+  int batchSize = batch.isEmpty() ? MIGRATE_BATCH_SIZE : batch.toInt();
+  if (batchSize <= 0)
+  {
+    cerr << "ERROR: Batch size " << batch << " is invalid!" << endl;
+    return 1;
+  }
+  cout << ".";
+
+  // prepare and check the root directory
+  QDir rootDir(rootPath);
+  if (!rootDir.exists())
+  {
+    cerr << "ERROR: Directory " << rootPath << " not found!" << endl;
+    return 1;
+  }
+  if (!rootDir.isReadable())
+  {
+    cerr << "ERROR: Directory " << rootPath << " not readable!" << endl;
+    return 1;
+  }
+  rootPath.replace('\\', '/');
+  if (rootPath.endsWith('/')) rootPath.remove(rootPath.length() - 1, 1);
+  cout << ".";
+
+  // prepare and check the bulk directory
+  QDir bulkDir(rootPath + "/bulk");
+  if (!bulkDir.exists() || !bulkDir.isReadable())
+  {
+    cerr << "ERROR: Directory " << bulkDir.path() << " not readable!" << endl;
+    return 1;
+  }
+  cout << ".";
+
+  // check for a database in the root path
+  if (!QFileInfo::exists(rootPath + "/database.s3db"))
+  {
+    cerr << "ERROR: Directory " << rootPath << " has no database!" << endl;
+    return 1;
+  }
+  cout << ".";
+
+  // open the application database
+  QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+  db.setDatabaseName(rootPath + "/database.s3db");
+  if (!db.open())
+  {
+    cerr << "ERROR: Database " << rootPath + "/database.s3db" << " cannot be opened!" << endl;
+    return 2;
+  }
+  cout << ".done" << endl;
+
+  // create a log file
+  QDateTime logTime = QDateTime::currentDateTime();
+  Logger::open(rootPath + "/log/" + QString("%1-%2-%3-%4-%5-%6.migrate.log")
+                                    .arg(logTime.date().year())
+                                    .arg(logTime.date().month(),  2, 10, QChar('0'))
+                                    .arg(logTime.date().day(),    2, 10, QChar('0'))
+                                    .arg(logTime.time().hour(),   2, 10, QChar('0'))
+                                    .arg(logTime.time().minute(), 2, 10, QChar('0'))
+                                    .arg(logTime.time().second(), 2, 10, QChar('0')));
+
+  // bring databases of older versions to the current schema
+  if (!upgradeDatabase())
+  {
+    cerr << "ERROR: Database " << rootPath + "/database.s3db" << " cannot be upgraded!" << endl;
+    Logger::close();
+    return 2;
+  }
+
+  // the new layout is recorded first, so the photos imported while the
+  // archive is migrated are already stored in the new layout
+  if (!writeLayout(layout))
+  {
+    cerr << "ERROR: Bulk layout cannot be written to the database!" << endl;
+    Logger::close();
+    return 2;
+  }
+
+  // each photo is renamed first and its path updated afterwards, one batch
+  // per transaction; an interrupted migration is simply started again, the
+  // photos already renamed are found at their new path. The triggers log
+  // the changed paths, the next incremental qtphotodb_symlnk run relinks them
+  cout << "Migrating to layout " << layout;
+  cout.flush();
+  QElapsedTimer timer;
+  timer.start();
+  MigrateStats stats = MigrateStats();
+  quint32 lastId = 0;
+  bool done = false;
+  while (!done)
+  {
+    if (!migrateBatch(bulkDir.path(), layout, batchSize, lastId, done, stats))
+    {
+      cerr << endl << "ERROR: Photo paths cannot be written to the database!" << endl;
+      Logger::close();
+      return 2;
+    }
+    cout << ".";
+    cout.flush();
+  }
+  int removed = removeEmptyDirs(bulkDir.path());
+  cout << "done" << endl;
+
+  qint64 elapsed = qMax(timer.elapsed(), Q_INT64_C(1));
+  cout << QString("%1 photos, %2 moved, %3 resumed, %4 failed, %5 empty directories removed in %6 s")
+          .arg(stats.photos)
+          .arg(stats.moved)
+          .arg(stats.resumed)
+          .arg(stats.failed)
+          .arg(removed)
+          .arg(elapsed / 1000.0, 0, 'f', 1) << endl;
+  if (stats.moved + stats.resumed > 0)
+  {
+    cout << "Run qtphotodb_symlnk to update the links of the views." << endl;
+  }
+  logInfo("migrate finished").field("layout", layout)
+                             .field("photos", stats.photos)
+                             .field("moved", stats.moved)
+                             .field("resumed", stats.resumed)
+                             .field("failed", stats.failed)
+                             .field("removed", removed)
+                             .field("ms", elapsed);
+
+  Logger::close();
+  return (stats.failed > 0) ? 3 : 0;
+}
+
+bool upgradeDatabase()
+{
+  QSqlQuery q(QSqlDatabase::database());
+
+  // Photos.Path: the path of the photo in the bulk directory
+  if (!QSqlDatabase::database().record("Photos").contains("Path"))
+  {
+    if (!q.exec("ALTER TABLE Photos ADD COLUMN [Path] VARCHAR(1024) NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Photos").field("sql", q.lastQuery());
+  }
+
+  // Photos.ObjectId: the photo owning the file of a shared photo
+  if (!QSqlDatabase::database().record("Photos").contains("ObjectId"))
+  {
+    if (!q.exec("ALTER TABLE Photos ADD COLUMN [ObjectId] INTEGER NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Photos").field("sql", q.lastQuery());
+  }
+
+  // Settings: options of the archive, e.g. BulkLayout
+  if (!QSqlDatabase::database().tables().contains("Settings"))
+  {
+    if (!q.exec("CREATE TABLE [Settings] ([Name] VARCHAR(32) PRIMARY KEY NOT NULL, [Value] VARCHAR(1024) NULL)"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Settings").field("sql", q.lastQuery());
+  }
+
+  return true;
+}
+
+bool writeLayout(const QString &layout)
+{
+  if (!writeSetting(QSqlDatabase::database(), "BulkLayout", layout))
+  {
+    logError("setting cannot be written").field("name", "BulkLayout").field("value", layout);
+    return false;
+  }
+  logInfo("layout written").field("layout", layout);
+  return true;
+}
+
+bool migrateBatch(const QString &bulkDirPath, const QString &layout, int batchSize, quint32 &lastId, bool &done, MigrateStats &stats)
+{
+  QSqlDatabase db = QSqlDatabase::database();
+  QSqlQuery q(db);
+  q.setForwardOnly(true);
+
+  // the next photos in catalog order
+  if (!q.prepare("SELECT Photos.Id,Photos.Name,Photos.Hash,Photos.Date,ifnull(Photos.Path,Photos.Name),Photos.ObjectId FROM Photos WHERE Photos.Id > ? ORDER BY Photos.Id LIMIT ?"))
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
+  }
+  q.bindValue(0, lastId);
+  q.bindValue(1, batchSize);
+  if (!q.exec())
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
+  }
+
+  // move the files, only the photos found at their new path are updated
+  QDir bulkDir(bulkDirPath);
+  QList<quint32> ids;
+  QStringList paths;
+  int count = 0;
+  while (q.next())
+  {
+    count++;
+    stats.photos++;
+    lastId = q.value(0).toUInt();
+
+    // photos sharing the file of another photo move with that photo
+    if (!q.isNull(5))
+    {
+      continue;
+    }
+
+    QString name    = q.value(1).toString();
+    QString oldPath = q.value(4).toString();
+    QString newPath = bulkPath(layout, name, q.value(2).toString(), q.value(3).toDateTime());
+    if (oldPath == newPath)
+    {
+      continue;
+    }
+
+    bulkDir.mkpath(QFileInfo(newPath).path());
+    if (bulkDir.rename(oldPath, newPath))
+    {
+      stats.moved++;
+      logDebug("photo moved").field("name", name).field("from", oldPath).field("to", newPath);
+    }
+    else if (!bulkDir.exists(oldPath) && bulkDir.exists(newPath))
+    {
+      // moved by an interrupted run, the database was not updated
+      stats.resumed++;
+      logDebug("photo resumed").field("name", name).field("to", newPath);
+    }
+    else
+    {
+      stats.failed++;
+      logError("photo cannot be moved").field("name", name).field("from", oldPath).field("to", newPath);
+      continue;
+    }
+    ids << lastId;
+    paths << ((newPath == name) ? QString() : newPath);
+  }
+  q.finish();
+  done = (count < batchSize);
+
+  if (ids.isEmpty())
+  {
+    return true;
+  }
+
+  // the path is NULL for bulk/<name>
+  db.transaction();
+  if (!q.prepare("UPDATE Photos SET Path=? WHERE Photos.Id=?"))
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    db.rollback();
+    return false;
+  }
+  for (int i = 0; i < ids.count(); i++)
+  {
+    q.bindValue(0, paths[i].isNull() ? QVariant(QVariant::String) : QVariant(paths[i]));
+    q.bindValue(1, ids[i]);
+    if (!q.exec())
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      db.rollback();
+      return false;
+    }
+  }
+  return db.commit();
+}
+
+int removeEmptyDirs(const QString &bulkPath)
+{
+  // the children sort after their parents and are removed first
+  QStringList dirs;
+  QDirIterator it(bulkPath, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+  while (it.hasNext())
+  {
+    dirs << it.next();
+  }
+  dirs.sort();
+
+  // rmdir() fails for directories which are not empty
+  int removed = 0;
+  QDir bulkDir(bulkPath);
+  for (int i = dirs.count() - 1; i >= 0; i--)
+  {
+    if (bulkDir.rmdir(dirs[i]))
+    {
+      removed++;
+      logDebug("directory removed").field("dir", bulkDir.relativeFilePath(dirs[i]));
+    }
+  }
+  return removed;
+}
@@ -0,0 +1,565 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "defines.h"
+#include "options.h"
+#include "../qtphotodb_import/exif.h"
+#include "../qtphotodb_import/exifsql.h"
+#include "../qtphotodb_import/imagesize.h"
+#include "../qtphotodb_import/bmff.h"
+#include "logger.h"
+
+// bytes read from the start of a file for the EXIF data (APP segments)
+#define EXIF_PREFIX_SIZE (256 * 1024)
+
+// photos parsed by the workers while the previous batch is written
+#define REINDEX_BATCH_SIZE 1000
+
+// EXIF fields stored in the Exif table
+#define EXIF_REINDEX_FIELDS (easyexif::EXIFInfo::FIELD_IMAGE_DESCRIPTION | \
+                             easyexif::EXIFInfo::FIELD_MAKE              | \
+                             easyexif::EXIFInfo::FIELD_MODEL             | \
+                             easyexif::EXIFInfo::FIELD_SOFTWARE          | \
+                             easyexif::EXIFInfo::FIELD_DATE_TIME         | \
+                             easyexif::EXIFInfo::FIELD_IMAGE_WIDTH       | \
+                             easyexif::EXIFInfo::FIELD_IMAGE_HEIGHT      | \
+                             easyexif::EXIFInfo::FIELD_GEO_LOCATION)
+
+QTextStream cout(stdout, QIODevice::WriteOnly);
+QTextStream cerr(stderr, QIODevice::WriteOnly);
+
+struct PhotoEntry
+{
+  quint32 id;
+  QString name;
+  QString path;     // relative to the bulk directory
+};
+
+struct ExifRecord
+{
+  quint32    photoId;
+  QString    name;
+  int        code;      // PARSE_EXIF_* code, -1 if the file cannot be read
+  qint64     bytes;     // bytes read from the file
+  bool       sized;     // dimensions found in the image header
+  QString    imageDescription;
+  QString    make;
+  QString    model;
+  QString    software;
+  QString    dateTime;
+  quint32    imageWidth;
+  quint32    imageHeight;
+  double     latitude;
+  double     longitude;
+  double     altitude;
+  double     duration;  // seconds, 0 for still images
+  QByteArray raw;
+};
+
+struct ReindexStats
+{
+  qint64 photos;
+  qint64 indexed;
+  qint64 noExif;
+  qint64 missing;
+  qint64 orphans;
+  qint64 bytes;
+};
+
+// reads the EXIF data of one bulk file, runs on the worker threads
+class ExifReader
+{
+  public:
+    typedef ExifRecord result_type;
+
+    ExifReader(const QString &bulkPath) : bulkPath(bulkPath) {}
+    ExifRecord operator()(const PhotoEntry &photo) const;
+
+  private:
+    QString bulkPath;
+};
+
+bool upgradeDatabase();
+bool loadPhotos (QList<PhotoEntry> &photos,
+                 bool onlyMissing);
+bool writeBatch (const QList<ExifRecord> &records,
+                 ReindexStats &stats);
+void findOrphans(const QString &bulkPath,
+                 ReindexStats &stats);
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  Options options;
+
+  bool noLogo = false;
+  bool onlyMissing = false;
+  QString rootPath;
+  QString jobs;
+
+  // set the application info
+  app.setApplicationName(APP_NAME);
+  app.setOrganizationName(APP_COMPANY);
+  app.setOrganizationDomain(APP_DOMAIN);
+  app.setApplicationVersion(APP_VERSION);
+
+  // add the application options
+  options.add(&rootPath,    "rootPath",                  "directory of the db",                      true );
+  options.add(&jobs,        "count",    "-jobs"        , "number of reader threads",                 false);
+  options.add(&onlyMissing, "",         "-only_missing", "only photos without exif data in the db",  false);
+  options.add(&noLogo,      "",         "-nologo"      , "do not show logo",                         false);
+
+  // set the application options values
+  if (!options.set())
+  {
+    cout << options.logo()  << endl;
+    cout << options.usage() << endl;
+    return 1;
+  }
+  else if (!noLogo)
+  {
+    // print copyright logo
+    cout << options.logo() << endl;
+  }
+
+  cout << "Initial check";
+  // prepare and check the root directory
+  QDir rootDir(rootPath);
+  if (!rootDir.exists())
+  {
+    cerr << "ERROR: Directory " << rootPath << " not found!" << endl;
+    return 1;
+  }
+  if (!rootDir.isReadable())
+  {
+    cerr << "ERROR: Directory " << rootPath << " not readable!" << endl;
+    return 1;
+  }
+  rootPath.replace('\\', '/');
+  if (rootPath.endsWith('/')) rootPath.remove(rootPath.length() - 1, 1);
+  cout << ".";
+
+  // prepare and check the bulk directory
+  QDir bulkDir(rootPath + "/bulk");
+  if (!bulkDir.exists() || !bulkDir.isReadable())
+  {
+    cerr << "ERROR: Directory " << bulkDir.path() << " not readable!" << endl;
+    return 1;
+  }
+  cout << ".";
+
+  // check for a database in the root path
+  if (!QFileInfo::exists(rootPath + "/database.s3db"))
+  {
+    cerr << "ERROR: Directory " << rootPath << " has no database!" << endl;
+    return 1;
+  }
+  cout << ".";
+
+  // open the application database
+  QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+  db.setDatabaseName(rootPath + "/database.s3db");
+  if (!db.open())
+  {
+    cerr << "ERROR: Database " << rootPath + "/database.s3db" << " cannot be opened!" << endl;
+    return 2;
+  }
+  if (!exifSqlAttach(db))
+  {
+    cerr << "WARNING: EXIF SQL functions not available for this database driver!" << endl;
+  }
+  cout << ".done" << endl;
+
+  // create a log file
+  QDateTime logTime = QDateTime::currentDateTime();
+  Logger::open(rootPath + "/log/" + QString("%1-%2-%3-%4-%5-%6.reindex.log")
+                                    .arg(logTime.date().year())
+                                    .arg(logTime.date().month(),  2, 10, QChar('0'))
+                                    .arg(logTime.date().day(),    2, 10, QChar('0'))
+                                    .arg(logTime.time().hour(),   2, 10, QChar('0'))
+                                    .arg(logTime.time().minute(), 2, 10, QChar('0'))
+                                    .arg(logTime.time().second(), 2, 10, QChar('0')));
+
+  // bring databases of older versions to the current schema
+  if (!upgradeDatabase())
+  {
+    cerr << "ERROR: Database " << rootPath + "/database.s3db" << " cannot be upgraded!" << endl;
+    Logger::close();
+    return 2;
+  }
+
+  // the photos to be reindexed, in catalog order
+  QList<PhotoEntry> photos;
+  if (!loadPhotos(photos, onlyMissing))
+  {
+    cerr << "ERROR: Photos cannot be read from the database!" << endl;
+    Logger::close();
+    return 2;
+  }
+
+  int threads = jobs.isEmpty() ? QThread::idealThreadCount() : jobs.toInt();
+  QThreadPool::globalInstance()->setMaxThreadCount(qMax(threads, 1));
+
+  ReindexStats stats = ReindexStats();
+  stats.photos = photos.count();
+
+  // the workers only read and parse the file headers, the main thread owns
+  // the database connection and writes one batch per transaction while the
+  // workers already parse the next batch
+  cout << "Reindexing " << photos.count() << " photos with " << QThreadPool::globalInstance()->maxThreadCount() << " jobs";
+  cout.flush();
+  QElapsedTimer timer;
+  timer.start();
+  ExifReader reader(bulkDir.path());
+  QFuture<ExifRecord> future = QtConcurrent::mapped(photos.mid(0, REINDEX_BATCH_SIZE), reader);
+  for (int offset = 0; offset < photos.count(); offset += REINDEX_BATCH_SIZE)
+  {
+    future.waitForFinished();
+    QList<ExifRecord> records = future.results();
+    if (offset + REINDEX_BATCH_SIZE < photos.count())
+    {
+      future = QtConcurrent::mapped(photos.mid(offset + REINDEX_BATCH_SIZE, REINDEX_BATCH_SIZE), reader);
+    }
+
+    if (!writeBatch(records, stats))
+    {
+      future.waitForFinished();
+      cerr << endl << "ERROR: Exif data cannot be written to the database!" << endl;
+      Logger::close();
+      return 2;
+    }
+    cout << ".";
+    cout.flush();
+  }
+  cout << "done" << endl;
+
+  // files which are in the bulk directory but not in the catalog
+  if (!onlyMissing)
+  {
+    findOrphans(bulkDir.path(), stats);
+  }
+
+  qint64 elapsed = qMax(timer.elapsed(), Q_INT64_C(1));
+  cout << QString("%1 photos, %2 indexed, %3 without exif, %4 missing, %5 orphans, %6 MB read in %7 s (%8 photos/s)")
+          .arg(stats.photos)
+          .arg(stats.indexed)
+          .arg(stats.noExif)
+          .arg(stats.missing)
+          .arg(stats.orphans)
+          .arg(stats.bytes / (1024 * 1024))
+          .arg(elapsed / 1000.0, 0, 'f', 1)
+          .arg(stats.photos * 1000.0 / elapsed, 0, 'f', 0) << endl;
+  logInfo("reindex finished").field("photos", stats.photos)
+                             .field("indexed", stats.indexed)
+                             .field("no_exif", stats.noExif)
+                             .field("missing", stats.missing)
+                             .field("orphans", stats.orphans)
+                             .field("bytes", stats.bytes)
+                             .field("ms", elapsed);
+
+  Logger::close();
+  return 0;
+}
+
+bool upgradeDatabase()
+{
+  QSqlQuery q(QSqlDatabase::database());
+
+  // Exif.Raw: the raw EXIF block of each photo
+  if (!QSqlDatabase::database().record("Exif").contains("Raw"))
+  {
+    if (!q.exec("ALTER TABLE Exif ADD COLUMN [Raw] BLOB NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Exif").field("sql", q.lastQuery());
+  }
+
+  // Exif.Duration: the length of video clips
+  if (!QSqlDatabase::database().record("Exif").contains("Duration"))
+  {
+    if (!q.exec("ALTER TABLE Exif ADD COLUMN [Duration] FLOAT NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Exif").field("sql", q.lastQuery());
+  }
+
+  // Photos.Path: the path of the photo in the bulk directory
+  if (!QSqlDatabase::database().record("Photos").contains("Path"))
+  {
+    if (!q.exec("ALTER TABLE Photos ADD COLUMN [Path] VARCHAR(1024) NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Photos").field("sql", q.lastQuery());
+  }
+
+  // Photos.ObjectId: the photo owning the file of a shared photo
+  if (!QSqlDatabase::database().record("Photos").contains("ObjectId"))
+  {
+    if (!q.exec("ALTER TABLE Photos ADD COLUMN [ObjectId] INTEGER NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Photos").field("sql", q.lastQuery());
+  }
+
+  return true;
+}
+
+bool loadPhotos(QList<PhotoEntry> &photos, bool onlyMissing)
+{
+  QSqlQuery q(QSqlDatabase::database());
+  q.setForwardOnly(true);
+
+  QString sql = "SELECT Photos.Id,Photos.Name,coalesce(Objects.Path,Objects.Name,Photos.Path,Photos.Name) "
+                "FROM Photos LEFT JOIN Photos AS Objects ON Photos.ObjectId = Objects.Id";
+  if (onlyMissing)
+  {
+    sql += " WHERE NOT EXISTS (SELECT 1 FROM Exif WHERE Exif.PhotoId=Photos.Id)";
+  }
+  sql += " ORDER BY Photos.Id";
+
+  if (!q.exec(sql))
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
+  }
+  while (q.next())
+  {
+    PhotoEntry photo;
+    photo.id   = q.value(0).toUInt();
+    photo.name = q.value(1).toString();
+    photo.path = q.value(2).toString();
+    photos.append(photo);
+  }
+
+  return true;
+}
+
+ExifRecord ExifReader::operator()(const PhotoEntry &photo) const
+{
+  ExifRecord record;
+  record.photoId     = photo.id;
+  record.name        = photo.name;
+  record.code        = -1;
+  record.bytes       = 0;
+  record.sized       = false;
+  record.imageWidth  = 0;
+  record.imageHeight = 0;
+  record.latitude    = 0;
+  record.longitude   = 0;
+  record.altitude    = 0;
+  record.duration    = 0;
+
+  // only the start of the file is read, the metadata segments and image
+  // headers are all in front of the image data
+  QFile file(bulkPath + "/" + photo.path);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    return record;
+  }
+  QByteArray buf = file.read(EXIF_PREFIX_SIZE);
+  record.bytes = buf.size();
+
+  // TIFF based files (TIFF, CR2, NEF, ARW, DNG) and ISO media files (HEIC,
+  // MP4, MOV) can keep their metadata anywhere in the file: larger ones are
+  // mapped, so only the pages the parsers touch are read
+  const unsigned char *data = reinterpret_cast<const unsigned char*>(buf.constData());
+  qint64 length = buf.size();
+  bool tiff = (buf.startsWith(QByteArray("II*\0", 4)) || buf.startsWith(QByteArray("MM\0*", 4)));
+  bool bmff = isBmff(data, length);
+  if ((bmff || (tiff && file.size() <= Q_INT64_C(0xFFFFFFFF))) && length == EXIF_PREFIX_SIZE)
+  {
+    const uchar *map = file.map(0, file.size());
+    if (map)
+    {
+      data   = map;
+      length = file.size();
+    }
+  }
+
+  // dimensions from the image header, the EXIF values are only used for
+  // formats the probe does not know; the raw EXIF block is kept for JPEG
+  // and HEIF only, a TIFF file is a TIFF block as a whole
+  easyexif::EXIFInfo result;
+  const unsigned char *raw = 0;
+  unsigned rawLength = 0;
+  if (bmff)
+  {
+    // box headers only, the EXIF data of HEIF images is a TIFF block item
+    BmffInfo media;
+    record.sized       = parseBmff(data, length, media) && media.width > 0 && media.height > 0;
+    record.imageWidth  = media.width;
+    record.imageHeight = media.height;
+    record.duration    = media.duration;
+    record.code        = PARSE_EXIF_ERROR_NO_EXIF;
+    if (media.exifLength > 0 && media.exifLength <= Q_UINT64_C(0xFFFFFFFF))
+    {
+      record.code = result.parseFromTIFF(data + media.exifOffset, media.exifLength, EXIF_REINDEX_FIELDS);
+      raw         = data + media.exifOffset;
+      rawLength   = media.exifLength;
+    }
+  }
+  else
+  {
+    record.code  = result.parseFrom(data, length, EXIF_REINDEX_FIELDS);
+    record.sized = imageSize(data, length, record.imageWidth, record.imageHeight);
+    if (!tiff)
+    {
+      raw       = data + result.TiffOffset;
+      rawLength = result.TiffLength;
+    }
+  }
+  if (record.code)
+  {
+    return record;
+  }
+  if (!record.sized)
+  {
+    record.imageWidth  = result.ImageWidth;
+    record.imageHeight = result.ImageHeight;
+  }
+
+  record.imageDescription = QString::fromStdString(result.ImageDescription);
+  record.make             = QString::fromStdString(result.Make);
+  record.model            = QString::fromStdString(result.Model);
+  record.software         = QString::fromStdString(result.Software);
+  record.dateTime         = QString::fromStdString(result.DateTime);
+  record.latitude         = result.GeoLocation.Latitude;
+  record.longitude        = result.GeoLocation.Longitude;
+  record.altitude         = result.GeoLocation.Altitude;
+  if (raw)
+  {
+    record.raw = QByteArray(reinterpret_cast<const char*>(raw), rawLength);
+  }
+
+  return record;
+}
+
+bool writeBatch(const QList<ExifRecord> &records, ReindexStats &stats)
+{
+  QSqlDatabase db = QSqlDatabase::database();
+  QSqlQuery d(db);
+  QSqlQuery q(db);
+
+  // one transaction per batch, the rows of a photo are replaced as a whole
+  db.transaction();
+  if (!d.prepare("DELETE FROM Exif WHERE Exif.PhotoId=?") ||
+      !q.prepare("INSERT INTO Exif (ImageDescription,Make,Model,Software,DateTime,ImageWidth,ImageHeight,Latitude,Longitude,Altitude,Raw,Duration,PhotoId)"
+                 "VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?)"))
+  {
+    QSqlQuery &failed = d.lastError().isValid() ? d : q;
+    logError("query failed").field("error", failed.lastError().text()).field("sql", failed.lastQuery());
+    db.rollback();
+    return false;
+  }
+
+  for (int i = 0; i < records.count(); i++)
+  {
+    const ExifRecord &record = records[i];
+    stats.bytes += record.bytes;
+    if (record.code < 0)
+    {
+      stats.missing++;
+      logWarning("file missing").field("name", record.name);
+      continue;
+    }
+    if (record.code)
+    {
+      stats.noExif++;
+      logWarning("exif parse failed").field("code", record.code).field("name", record.name);
+      if (!record.sized)
+      {
+        continue;
+      }
+    }
+
+    d.bindValue(0, record.photoId);
+    if (!d.exec())
+    {
+      logError("query failed").field("error", d.lastError().text()).field("sql", d.lastQuery());
+      db.rollback();
+      return false;
+    }
+
+    // without EXIF data only the dimensions are known
+    QVariant none;
+    q.bindValue(0,  record.code ? none : record.imageDescription);
+    q.bindValue(1,  record.code ? none : record.make);
+    q.bindValue(2,  record.code ? none : record.model);
+    q.bindValue(3,  record.code ? none : record.software);
+    q.bindValue(4,  record.code ? none : record.dateTime);
+    q.bindValue(5,  record.imageWidth);
+    q.bindValue(6,  record.imageHeight);
+    q.bindValue(7,  record.code ? none : record.latitude);
+    q.bindValue(8,  record.code ? none : record.longitude);
+    q.bindValue(9,  record.code ? none : record.altitude);
+    q.bindValue(10, record.code ? none : record.raw);
+    q.bindValue(11, record.duration > 0 ? QVariant(record.duration) : none);
+    q.bindValue(12, record.photoId);
+    if (!q.exec())
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      db.rollback();
+      return false;
+    }
+    stats.indexed++;
+    logDebug("reindexed").field("name", record.name);
+  }
+
+  return db.commit();
+}
+
+void findOrphans(const QString &bulkPath, ReindexStats &stats)
+{
+  QSet<QString> paths;
+  QSqlQuery q(QSqlDatabase::database());
+  q.setForwardOnly(true);
+  if (!q.exec("SELECT ifnull(Photos.Path,Photos.Name) FROM Photos WHERE Photos.ObjectId IS NULL"))
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return;
+  }
+  while (q.next())
+  {
+    paths.insert(q.value(0).toString());
+  }
+
+  // the layouts other than flat keep the photos in sub-directories
+  QDir bulkDir(bulkPath);
+  QDirIterator it(bulkPath, QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext())
+  {
+    QString path = bulkDir.relativeFilePath(it.next());
+    if (!paths.contains(path))
+    {
+      stats.orphans++;
+      logWarning("orphan file").field("name", path);
+    }
+  }
+}
@@ -0,0 +1,261 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "linkengine.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+// directories kept open by one engine, at most and at least
+#define LINK_DIR_CACHE     256
+#define LINK_DIR_CACHE_MIN 8
+
+// descriptors left to the database, the log and reflink()
+#define LINK_FD_RESERVE    64
+
+LinkEngine::LinkEngine(const QString &viewPath, Type type, bool fresh, int dirCache)
+  : viewPath(QFile::encodeName(viewPath)), type(type), fresh(fresh)
+{
+  this->dirCache = (dirCache > 0) ? dirCache : LINK_DIR_CACHE;
+}
+
+LinkEngine::~LinkEngine()
+{
+  closeDirs();
+}
+
+LinkEngine::Result LinkEngine::link(const QByteArray &dirPath, const QByteArray &name, const QByteArray &target)
+{
+  // a cached directory may have been removed meanwhile, it is reopened
+  // (and created again) once; when the process runs out of descriptors the
+  // cache is emptied and the link tried once more
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    int dirFd = openDir(dirPath);
+    if (dirFd < 0 && (errno == EMFILE || errno == ENFILE) && attempt == 0)
+    {
+      closeDirs();
+      continue;
+    }
+    if (dirFd < 0)
+    {
+      logError("directory cannot be created").field("dir", QFile::decodeName(dirPath)).field("error", strerror(errno));
+      return Failed;
+    }
+
+    int result = -1;
+    switch (type)
+    {
+      case Symlink:  result = symlinkat(target.constData(), dirFd, name.constData());                  break;
+      case Hardlink: result = linkat(dirFd, target.constData(), dirFd, name.constData(), 0);          break;
+      case Reflink:  result = reflink(dirFd, target.constData(), name.constData());                   break;
+    }
+    if (result == 0)
+    {
+      return Linked;
+    }
+    if (errno == EEXIST)
+    {
+      return (type == Symlink) ? relink(dirFd, target, name) : Exists;
+    }
+    if (errno != ENOENT && errno != EMFILE && errno != ENFILE)
+    {
+      break;
+    }
+    closeDirs();
+  }
+
+  logError("link cannot be created").field("dir", QFile::decodeName(dirPath)).field("file", QFile::decodeName(name)).field("error", strerror(errno));
+  return Failed;
+}
+
+int LinkEngine::dirBudget(int engines)
+{
+  // the descriptor limit of the process is shared by all engines which are
+  // running at the same time
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+  {
+    return LINK_DIR_CACHE;
+  }
+  qint64 budget = (qint64(limit.rlim_cur) - LINK_FD_RESERVE) / qMax(engines, 1);
+  return int(qBound<qint64>(LINK_DIR_CACHE_MIN, budget, LINK_DIR_CACHE));
+}
+
+bool LinkEngine::parseType(const QString &name, Type &type)
+{
+  if      (name == "symlink") type = Symlink;
+  else if (name == "hard")    type = Hardlink;
+  else if (name == "reflink") type = Reflink;
+  else return false;
+  return true;
+}
+
+QString LinkEngine::typeName(Type type)
+{
+  switch (type)
+  {
+    case Symlink:  return "symlink";
+    case Hardlink: return "hard";
+    case Reflink:  return "reflink";
+  }
+  return QString();
+}
+
+LinkEngine::Result LinkEngine::relink(int dirFd, const QByteArray &target, const QByteArray &name)
+{
+  // the photo may have been moved in bulk/ (qtphotodb_migrate), a symlink
+  // to another target is replaced atomically, anything else is kept
+  char current[PATH_MAX];
+  ssize_t length = readlinkat(dirFd, name.constData(), current, sizeof(current));
+  if (length < 0 || (length == target.length() && memcmp(current, target.constData(), length) == 0))
+  {
+    return Exists;
+  }
+
+  QByteArray temp = "." + name + ".new";
+  unlinkat(dirFd, temp.constData(), 0);
+  if (symlinkat(target.constData(), dirFd, temp.constData()) != 0 ||
+      renameat(dirFd, temp.constData(), dirFd, name.constData()) != 0)
+  {
+    logError("link cannot be replaced").field("file", QFile::decodeName(name)).field("error", strerror(errno));
+    unlinkat(dirFd, temp.constData(), 0);
+    return Failed;
+  }
+  return Linked;
+}
+
+int LinkEngine::reflink(int dirFd, const char *target, const char *name)
+{
+  int sourceFd = openat(dirFd, target, O_RDONLY | O_CLOEXEC);
+  if (sourceFd < 0)
+  {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(sourceFd, &st) != 0)
+  {
+    close(sourceFd);
+    return -1;
+  }
+
+  // O_EXCL reports an existing file as EEXIST like the other link types
+  int fileFd = openat(dirFd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 0777);
+  if (fileFd < 0)
+  {
+    close(sourceFd);
+    return -1;
+  }
+
+  // the clone keeps the modification time of the photo
+  int result = ioctl(fileFd, FICLONE, sourceFd);
+  if (result == 0)
+  {
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    futimens(fileFd, times);
+  }
+
+  int error = errno;
+  close(fileFd);
+  close(sourceFd);
+  if (result != 0)
+  {
+    // no partial copies are left behind, and ENOENT must not look like a
+    // removed directory to link()
+    unlinkat(dirFd, name, 0);
+    errno = (error == ENOENT) ? EIO : error;
+  }
+  return result;
+}
+
+int LinkEngine::openDir(const QByteArray &dirPath)
+{
+  QHash<QByteArray, int>::const_iterator it = dirList.constFind(dirPath);
+  if (it != dirList.constEnd())
+  {
+    return it.value();
+  }
+
+  // the parent is opened first, the view directory itself is the root
+  int parentFd = AT_FDCWD;
+  QByteArray name = viewPath;
+  if (!dirPath.isEmpty())
+  {
+    int slash = dirPath.lastIndexOf('/');
+    parentFd = openDir(slash < 0 ? QByteArray() : dirPath.left(slash));
+    if (parentFd < 0)
+    {
+      return -1;
+    }
+    name = dirPath.mid(slash + 1);
+  }
+
+  // other workers may create the same directory at the same time, EEXIST
+  // just means it is there
+  if (fresh && mkdirat(parentFd, name.constData(), 0777) != 0 && errno != EEXIST)
+  {
+    return -1;
+  }
+  int dirFd = openat(parentFd, name.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd < 0 && errno == ENOENT && !fresh)
+  {
+    if (mkdirat(parentFd, name.constData(), 0777) != 0 && errno != EEXIST)
+    {
+      return -1;
+    }
+    dirFd = openat(parentFd, name.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  }
+  if (dirFd < 0)
+  {
+    return -1;
+  }
+
+  // the file descriptors are limited, a full cache is started over (the
+  // parents are reopened on demand)
+  if (dirList.count() >= dirCache)
+  {
+    closeDirs();
+  }
+  dirList.insert(dirPath, dirFd);
+  return dirFd;
+}
+
+void LinkEngine::closeDirs()
+{
+  QHash<QByteArray, int>::const_iterator it;
+  for (it = dirList.constBegin(); it != dirList.constEnd(); ++it)
+  {
+    close(it.value());
+  }
+  dirList.clear();
+}
@@ -0,0 +1,71 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef LINKENGINE_H
+#define LINKENGINE_H
+
+// Creates the links of one view. The directories of the view are opened
+// once and kept open, links are created relative to them, so a link in a
+// known directory costs a single symlinkat() call. Existing links are not
+// checked upfront, EEXIST is reported as Exists instead (a symlink to
+// another target is replaced and reported as Linked). In a fresh view
+// tree the directories are created right away, without looking them up.
+//
+// Instead of symbolic links the view may hold hard links (the view must be
+// on the file system of bulk/) or reflinks, copies sharing the data blocks
+// of the bulk file (btrfs, xfs), for clients which do not follow symlinks.
+class LinkEngine
+{
+  public:
+    enum Type   { Symlink, Hardlink, Reflink };
+    enum Result { Linked, Exists, Failed };
+
+    // 'dirCache' is the number of directories kept open, see dirBudget()
+    LinkEngine(const QString &viewPath, Type type = Symlink, bool fresh = false, int dirCache = 0);
+    virtual ~LinkEngine();
+
+    // 'dirPath' is relative to the view directory and created if missing,
+    // 'target' is relative to 'dirPath', all paths are encoded file names
+    Result link(const QByteArray &dirPath, const QByteArray &name, const QByteArray &target);
+
+    // directories each of 'engines' engines may keep open within the
+    // descriptor limit of the process
+    static int     dirBudget(int engines);
+
+    // names of the link types: symlink, hard, reflink
+    static bool    parseType(const QString &name, Type &type);
+    static QString typeName (Type type);
+
+  private:
+    int    openDir(const QByteArray &dirPath);
+    void   closeDirs();
+    Result relink (int dirFd, const QByteArray &target, const QByteArray &name);
+    int    reflink(int dirFd, const char *target, const char *name);
+
+  private:
+    QByteArray viewPath;
+    Type type;
+    bool fresh;
+    int  dirCache;
+    QHash<QByteArray, int> dirList;
+};
+
+#endif // LINKENGINE_H
@@ -0,0 +1,378 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "logger.h"
+
+#include <stdio.h>
+
+// pending bytes after which the writer thread hands a batch to the log file
+#define LOG_BATCH_SIZE   (1024 * 1024)
+// time the writer thread sleeps when the queue is empty
+#define LOG_IDLE_MS      20
+
+struct LogEntry
+{
+  QAtomicPointer<LogEntry> next;
+  qint64 time;
+  Logger::Level level;
+  QString text;
+};
+
+class LogWriter : public QThread
+{
+  public:
+    LogWriter();
+    virtual ~LogWriter();
+
+    void push(LogEntry *entry);
+    void stop();
+    void flush();
+
+  protected:
+    void run();
+
+  private:
+    LogEntry *pop();
+    bool drain();
+    void write(bool sync);
+
+  public:
+    QFile file;
+    QAtomicInt level;
+
+  private:
+    QByteArray fileBuffer, errorBuffer;
+    QAtomicInt stopRequest, flushRequest;
+    QSemaphore flushDone;
+    QMutex flushMutex;
+
+    // intrusive multiple producer / single consumer queue, producers only
+    // swap the head pointer, the writer thread is the only one using tail
+    QAtomicPointer<LogEntry> head;
+    LogEntry *tail;
+    LogEntry stub;
+};
+
+static LogWriter *writer = 0;
+
+static const char *levelName(Logger::Level level)
+{
+  switch (level)
+  {
+    case Logger::Debug:   return "DEBUG";
+    case Logger::Info:    return "INFO ";
+    case Logger::Warning: return "WARN ";
+    case Logger::Error:   return "ERROR";
+    case Logger::Fatal:   return "FATAL";
+  }
+  return "";
+}
+
+LogWriter::LogWriter()
+{
+  stub.next.store(0);
+  head.store(&stub);
+  tail = &stub;
+  level.store(Logger::Info);
+}
+
+LogWriter::~LogWriter()
+{
+}
+
+void LogWriter::push(LogEntry *entry)
+{
+  entry->next.store(0);
+  LogEntry *prev = head.fetchAndStoreOrdered(entry);
+  prev->next.storeRelease(entry);
+}
+
+LogEntry *LogWriter::pop()
+{
+  LogEntry *entry = tail;
+  LogEntry *next  = entry->next.loadAcquire();
+
+  // skip the stub node
+  if (entry == &stub)
+  {
+    if (!next)
+    {
+      return 0;
+    }
+    tail  = next;
+    entry = next;
+    next  = next->next.loadAcquire();
+  }
+
+  if (next)
+  {
+    tail = next;
+    return entry;
+  }
+
+  // a producer swapped the head but did not link its entry yet
+  if (entry != head.loadAcquire())
+  {
+    return 0;
+  }
+
+  // last entry in the queue, put the stub back behind it
+  push(&stub);
+  next = entry->next.loadAcquire();
+  if (next)
+  {
+    tail = next;
+    return entry;
+  }
+
+  return 0;
+}
+
+bool LogWriter::drain()
+{
+  bool drained = false;
+  LogEntry *entry;
+
+  while ((entry = pop()) != 0)
+  {
+    QByteArray text = entry->text.toUtf8();
+
+    fileBuffer += QDateTime::fromMSecsSinceEpoch(entry->time).toString("yyyy-MM-dd hh:mm:ss.zzz").toLatin1();
+    fileBuffer += ' ';
+    fileBuffer += levelName(entry->level);
+    fileBuffer += ' ';
+    fileBuffer += text;
+    fileBuffer += '\n';
+
+    // errors are still reported on the console as before
+    if (entry->level >= Logger::Error)
+    {
+      errorBuffer += levelName(entry->level);
+      errorBuffer += ": ";
+      errorBuffer += text;
+      errorBuffer += '\n';
+    }
+
+    delete entry;
+    drained = true;
+  }
+
+  return drained;
+}
+
+void LogWriter::write(bool sync)
+{
+  if (!fileBuffer.isEmpty())
+  {
+    file.write(fileBuffer);
+    fileBuffer.resize(0);
+  }
+  if (sync)
+  {
+    file.flush();
+  }
+
+  if (!errorBuffer.isEmpty())
+  {
+    fwrite(errorBuffer.constData(), 1, errorBuffer.size(), stderr);
+    fflush(stderr);
+    errorBuffer.resize(0);
+  }
+}
+
+void LogWriter::run()
+{
+  forever
+  {
+    bool stopping = stopRequest.loadAcquire();
+    bool flushing = flushRequest.loadAcquire();
+    bool drained  = drain();
+
+    // write in large batches, the file is only flushed on request
+    if (fileBuffer.size() >= LOG_BATCH_SIZE || !errorBuffer.isEmpty() || stopping || flushing)
+    {
+      write(stopping || flushing);
+    }
+
+    if (flushing)
+    {
+      flushRequest.storeRelease(0);
+      flushDone.release();
+    }
+
+    if (stopping)
+    {
+      break;
+    }
+
+    if (!drained)
+    {
+      msleep(LOG_IDLE_MS);
+    }
+  }
+}
+
+void LogWriter::stop()
+{
+  stopRequest.storeRelease(1);
+  wait();
+}
+
+void LogWriter::flush()
+{
+  QMutexLocker locker(&flushMutex);
+  flushRequest.storeRelease(1);
+  flushDone.acquire();
+}
+
+bool Logger::open(const QString &filePath, Level level)
+{
+  close();
+
+  writer = new LogWriter();
+  writer->file.setFileName(filePath);
+  writer->level.store(level);
+  if (!writer->file.open(QIODevice::WriteOnly))
+  {
+    delete writer;
+    writer = 0;
+    return false;
+  }
+  writer->start();
+
+  return true;
+}
+
+void Logger::close()
+{
+  if (writer)
+  {
+    writer->stop();
+    writer->file.close();
+    delete writer;
+    writer = 0;
+  }
+}
+
+void Logger::flush()
+{
+  if (writer)
+  {
+    writer->flush();
+  }
+}
+
+void Logger::setLevel(Level level)
+{
+  if (writer)
+  {
+    writer->level.store(level);
+  }
+}
+
+bool Logger::enabled(Level level)
+{
+  return !writer || level >= writer->level.load();
+}
+
+void Logger::enqueue(Level level, const QString &text)
+{
+  // no log file open (yet), report the important things on the console
+  if (!writer)
+  {
+    if (level >= Warning)
+    {
+      fprintf(stderr, "%s: %s\n", levelName(level), text.toLocal8Bit().constData());
+    }
+    return;
+  }
+
+  LogEntry *entry = new LogEntry();
+  entry->time  = QDateTime::currentMSecsSinceEpoch();
+  entry->level = level;
+  entry->text  = text;
+  writer->push(entry);
+}
+
+LogRecord::LogRecord(Logger::Level level, const QString &message)
+{
+  this->level  = level;
+  this->active = Logger::enabled(level);
+  if (active)
+  {
+    text = message;
+  }
+}
+
+LogRecord::LogRecord(const LogRecord &other)
+{
+  // the copy takes over the record, only one of them is logged
+  level  = other.level;
+  text   = other.text;
+  active = other.active;
+  other.active = false;
+}
+
+LogRecord::~LogRecord()
+{
+  if (active)
+  {
+    Logger::enqueue(level, text);
+    if (level == Logger::Fatal)
+    {
+      Logger::flush();
+    }
+  }
+}
+
+LogRecord &LogRecord::field(const char *name, const QString &value)
+{
+  if (active)
+  {
+    text += ' ';
+    text += QLatin1String(name);
+    text += '=';
+    if (value.isEmpty() || value.contains(' ') || value.contains('=') || value.contains('"'))
+    {
+      QString quoted = value;
+      quoted.replace('"', "\\\"");
+      text += '"' + quoted + '"';
+    }
+    else
+    {
+      text += value;
+    }
+  }
+  return *this;
+}
+
+LogRecord &LogRecord::field(const char *name, qint64 value)
+{
+  if (active)
+  {
+    text += ' ';
+    text += QLatin1String(name);
+    text += '=';
+    text += QString::number(value);
+  }
+  return *this;
+}
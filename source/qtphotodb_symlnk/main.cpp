@@ -22,14 +22,79 @@
 #include "stable.h"
 #include "defines.h"
 #include "options.h"
+#include "sqlprofile.h"
+#include "logger.h"
+#include "linkengine.h"
+#include "viewprune.h"
+#include "viewtemplate.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+// smallest Id range linked by one worker
+#define LINK_PARTITION_MIN 1024
 
 QTextStream cout(stdout, QIODevice::WriteOnly);
 QTextStream cerr(stderr, QIODevice::WriteOnly);
 
-bool linkByDate (QDir sortDir);
-bool linkByTag  (QDir sortDir);
-bool linkByAlbum(QDir sortDir);
-bool linkBySize (QDir sortDir);
+// one partition of the catalog: the photos with an Id in [idFirst, idLast],
+// linked into all requested views
+struct LinkTask
+{
+  QStringList views;
+  QList<ViewTemplate> templates;
+  QList<LinkEngine::Type> types;
+  qint64  watermark;  // -1 for all photos
+  bool    rebuild;    // link into the staging directories
+  qint64  idFirst;
+  qint64  idLast;
+};
+
+// links one partition with its own database connection, runs on the
+// worker threads
+class LinkWorker
+{
+  public:
+    typedef bool result_type;
+
+    LinkWorker(const QString &databasePath, const QDir &sortDir, SqlProfile *profile)
+      : databasePath(databasePath), sortDir(sortDir), profile(profile) {}
+    bool operator()(const LinkTask &task) const;
+
+  private:
+    QString     databasePath;
+    QDir        sortDir;
+    SqlProfile *profile;
+};
+
+qint64 currentSequence();
+bool   upgradeDatabase();
+qint64 viewWatermark (const QString &view);
+QString viewLinkType (const QString &view);
+bool   setWatermark  (const QString &view, qint64 sequence, const QString &linkType);
+bool   pruneChangeLog();
+bool   photoRange    (qint64 watermark, qint64 &idFirst, qint64 &idLast);
+bool   selectPhotos  (QSqlQuery &q, QString sql, const LinkTask &task);
+
+bool linkPhotos(QSqlDatabase db, QDir sortDir, const LinkTask &task);
+bool pruneView (QDir sortDir, const ViewTemplate &view, LinkEngine::Type type);
+
+QString viewDirName(const QString &view, bool staging);
+bool    swapView   (QDir sortDir, const QString &view, QString &oldViewPath);
+bool    removeView (const QString &viewPath);
+
+// progress output of the workers, one dot per partition; the links are
+// counted per partition and added up once
+static QMutex        outputMutex;
+static QAtomicInt    linkCount;
 
 int main(int argc, char *argv[])
 {
@@ -37,8 +102,14 @@ int main(int argc, char *argv[])
   Options options;
 
   bool noLogo = false;
+  bool sqlProfile = false;
+  bool full = false;
+  bool prune = false;
+  bool rebuild = false;
   QString rootPath;
   QString linkBy;
+  QString jobs;
+  QString linkType;
 
   // set the application info
   app.setApplicationName(APP_NAME);
@@ -47,9 +118,15 @@ int main(int argc, char *argv[])
   app.setApplicationVersion(APP_VERSION);
 
   // add the application options
-  options.add(&rootPath, "rootPath",             "directory where the db shall be created", true );
-  options.add(&linkBy,   "linkBy",   "-link_by", "lynk by (date, tag, size, album)",        true );
-  options.add(&noLogo,   "",         "-nologo" , "do not show logo",                        false);
+  options.add(&rootPath,   "rootPath",                 "directory where the db shall be created", true );
+  options.add(&linkBy,     "linkBy",   "-link_by"    , "link by (date, tag, size, album, name=template)", true );
+  options.add(&noLogo,     "",         "-nologo"     , "do not show logo",                        false);
+  options.add(&sqlProfile, "",         "-sql_profile", "print sql statement statistics at exit",  false);
+  options.add(&full,       "",         "-full"       , "link all photos, not only the changed",   false);
+  options.add(&jobs,       "count",    "-jobs"       , "number of link threads",                  false);
+  options.add(&prune,      "",         "-prune"      , "remove links not in the database anymore", false);
+  options.add(&rebuild,    "",         "-rebuild"    , "rebuild the views and swap them in",       false);
+  options.add(&linkType,   "type",     "-link_type"  , "symlink, hard or reflink",                 false);
 
   // set the application options values
   if (!options.set())
@@ -109,235 +186,589 @@ int main(int argc, char *argv[])
     cerr << "Database " << rootPath + "/database.s3db" << " canot be opened!" << endl;
     return 2;
   }
+  SqlProfile profile;
+  if (sqlProfile && !profile.attach(db))
+  {
+    cerr << "WARNING: SQL profiling not available for this database driver!" << endl;
+  }
   cout << "done" << endl;
 
+  // create a log file
+  QDateTime logTime = QDateTime::currentDateTime();
+  Logger::open(rootPath + "/log/" + QString("%1-%2-%3-%4-%5-%6.symlnk.log")
+                                    .arg(logTime.date().year())
+                                    .arg(logTime.date().month(),  2, 10, QChar('0'))
+                                    .arg(logTime.date().day(),    2, 10, QChar('0'))
+                                    .arg(logTime.time().hour(),   2, 10, QChar('0'))
+                                    .arg(logTime.time().minute(), 2, 10, QChar('0'))
+                                    .arg(logTime.time().second(), 2, 10, QChar('0')));
+
+  // incremental runs need the change log of the catalog, which is kept by
+  // triggers (created by qtphotodb_create, or by qtphotodb_import for older
+  // databases); each view links the photos changed since its watermark
+  bool changeLog = db.tables().contains("ChangeLog") && db.tables().contains("Views");
+  if (!changeLog)
+  {
+    cerr << "WARNING: Database has no change log, all photos are linked!" << endl;
+  }
+  qint64 sequence = changeLog ? currentSequence() : 0;
+
+  // the link type of each view is kept with its watermark, the photos are
+  // linked by their path in bulk/
+  if (!upgradeDatabase())
+  {
+    cerr << "ERROR: Database " << rootPath + "/database.s3db" << " cannot be upgraded!" << endl;
+    Logger::close();
+    return 2;
+  }
+  LinkEngine::Type type = LinkEngine::Symlink;
+  if (!linkType.isEmpty() && !LinkEngine::parseType(linkType, type))
+  {
+    cerr << "ERROR: Link type " << linkType << " is unknown!" << endl;
+    Logger::close();
+    return 1;
+  }
+
+  int threads = qMax(jobs.isEmpty() ? QThread::idealThreadCount() : jobs.toInt(), 1);
+  QThreadPool::globalInstance()->setMaxThreadCount(threads);
+
+  // the catalog is scanned once for all views, one row per photo with its
+  // tags and albums; the scan is split into Id ranges which are linked
+  // concurrently, a few partitions per thread keep the threads busy when the
+  // photos are not evenly spread over the Id range
   QStringList linkByList = linkBy.split(',', QString::SkipEmptyParts);
+  LinkTask task;
+  task.watermark = -1;
+  QStringList linkedTypes;
   for (int i = 0; i < linkByList.count(); i++)
   {
-    cout << "Linking by " << linkByList[i]; cout.flush();
-    if (linkByList[i] == "date")
+    // builtin views or user defined ones, e.g. camera={make}/{model}/{yyyy}
+    ViewTemplate view;
+    if (!view.parse(linkByList[i]))
     {
-      linkByDate(sortDir);
+      cerr << "WARNING: View " << linkByList[i] << " is unknown or its template is not valid!" << endl;
+      continue;
     }
-    else if ( linkByList[i] == "tag" )
+
+    // views keep their link type unless another one is given, the links of
+    // a view are then replaced by a rebuild
+    QString linkedType = changeLog ? viewLinkType(view.name()) : QString();
+    LinkEngine::Type viewType = type;
+    if (linkType.isEmpty() && !LinkEngine::parseType(linkedType, viewType))
     {
-      linkByTag(sortDir);
+      viewType = LinkEngine::Symlink;
     }
-    else if ( linkByList[i] == "album" )
+    if (!linkedType.isEmpty() && linkedType != LinkEngine::typeName(viewType) && !rebuild)
     {
-      linkByAlbum(sortDir);
+      cout << "View " << view.name() << " changes from " << linkedType << " to " << LinkEngine::typeName(viewType) << ", the views are rebuilt" << endl;
+      rebuild = true;
     }
-    else if ( linkByList[i] == "size" )
+    task.views << view.name();
+    task.templates << view;
+    task.types << viewType;
+    linkedTypes << (linkedType.isEmpty() ? LinkEngine::typeName(viewType) : linkedType);
+  }
+
+  task.rebuild = rebuild;
+  for (int i = 0; i < task.views.count(); i++)
+  {
+    const ViewTemplate &view = task.templates[i];
+
+    // a rebuild starts from an empty staging tree, left-overs of a failed
+    // rebuild are removed first
+    QString viewDir = viewDirName(view.name(), rebuild);
+    if (rebuild && QFileInfo::exists(sortDir.path() + "/" + viewDir))
     {
-      linkBySize(sortDir);
+      removeView(sortDir.path() + "/" + viewDir);
+    }
+    if (!QFileInfo::exists(sortDir.path() + "/" + viewDir))
+    {
+      sortDir.mkdir(viewDir);
     }
-    cout << "done" << endl;
-  }
 
-  return 0;
-}
+    // the scan starts at the oldest watermark of the views, views without a
+    // watermark are linked completely (links which exist are skipped)
+    qint64 watermark = (changeLog && !full && !rebuild) ? viewWatermark(view.name()) : -1;
+    task.watermark = (i == 0) ? watermark : qMin(task.watermark, watermark);
+  }
 
-bool linkByDate(QDir sortDir)
-{
-  QDir linkRoot(sortDir.path() + "/by_date");
-  if (!linkRoot.exists(sortDir.path() + "/by_date"))
+  qint64 idFirst = 0, idLast = -1;
+  if (!task.views.isEmpty() && !photoRange(task.watermark, idFirst, idLast))
   {
-    sortDir.mkdir("by_date");
+    cerr << "ERROR: Photos cannot be read from the database!" << endl;
+    Logger::close();
+    return 2;
   }
 
-  QSqlQuery q(QSqlDatabase::database());
-  if (!q.exec("SELECT Photos.Name,Photos.Date FROM Photos"))
+  QList<LinkTask> tasks;
+  qint64 partition = qMax((idLast - idFirst) / (threads * 4) + 1, qint64(LINK_PARTITION_MIN));
+  for (task.idFirst = idFirst; task.idFirst <= idLast; task.idFirst += partition)
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
-    return false;
+    task.idLast = qMin(task.idFirst + partition - 1, idLast);
+    tasks << task;
   }
-  int cnt = 0;
-  while (q.next())
-  {
-    QString   name  = q.value(0).toString();
-    QDateTime tstmp = q.value(1).toDateTime();
 
-    // absolute link directory path
-    QString linkDirPath = QString("%1/%2/%3/%4")
-                          .arg(sortDir.path() + "/by_date")
-                          .arg(tstmp.date().year())
-                          .arg(tstmp.date().month(), 2, 10, QChar('0'))
-                          .arg(tstmp.date().day()  , 2, 10, QChar('0'));
+  cout << "Linking by " << task.views.join(",") << " with " << QThreadPool::globalInstance()->maxThreadCount() << " jobs";
+  cout.flush();
+  LinkWorker worker(rootPath + "/database.s3db", sortDir, sqlProfile ? &profile : 0);
+  QList<bool> linked = QtConcurrent::blockingMapped(tasks, worker);
+  cout << "done, " << linkCount.load() << " links created" << endl;
 
-    // absolute link file path
-    QString linkFilePath = QString("%1/%2")
-                           .arg(linkDirPath)
-                           .arg(name);
+  // the views are up to date when all partitions are linked
+  if (changeLog && !linked.contains(false))
+  {
+    for (int i = 0; i < task.views.count(); i++)
+    {
+      setWatermark(task.views[i], sequence, LinkEngine::typeName(task.types[i]));
+    }
+  }
+
+  // the rebuilt views replace the live ones in one step each, so clients
+  // always see a complete tree; the old trees are removed in the background
+  QList< QFuture<bool> > removals;
+  for (int i = 0; i < task.views.count() && rebuild; i++)
+  {
+    if (linked.contains(false))
+    {
+      cerr << "ERROR: View " << task.views[i] << " not rebuilt, the current one is kept!" << endl;
+      continue;
+    }
+    QString oldViewPath;
+    if (!swapView(sortDir, task.views[i], oldViewPath))
+    {
+      cerr << "ERROR: View " << task.views[i] << " cannot be swapped!" << endl;
+
+      // the live view misses the changes, the next run links all photos
+      if (changeLog)
+      {
+        setWatermark(task.views[i], -1, linkedTypes[i]);
+      }
+      continue;
+    }
+    if (!oldViewPath.isEmpty())
+    {
+      removals << QtConcurrent::run(removeView, oldViewPath);
+    }
+  }
 
-    // relative target file path
-    QString targetFilePath = QString("../../../../../bulk/%1")
-                             .arg(name);
+  // links of photos, tags and albums which were changed or removed
+  for (int i = 0; i < task.views.count() && prune && !rebuild; i++)
+  {
+    cout << "Pruning by " << task.views[i]; cout.flush();
+    if (!pruneView(sortDir, task.templates[i], task.types[i]))
+    {
+      cerr << endl << "ERROR: View " << task.views[i] << " not pruned completely!" << endl;
+      continue;
+    }
+    cout << "done" << endl;
+  }
 
-    // if link file exists continue with next item
-    if (QFileInfo(linkFilePath).exists()) continue;
+  // changes seen by all views are not needed anymore
+  if (changeLog)
+  {
+    pruneChangeLog();
+  }
 
-    // create the directory and make sure it exists
-    QDir linkDir(linkDirPath); linkDir.mkpath(linkDirPath);
+  for (int i = 0; i < removals.count(); i++)
+  {
+    removals[i].waitForFinished();
+  }
 
-    // create the link
-    QFile::link(targetFilePath, linkFilePath);
-    cnt++; cout << "."; cout.flush(); if (cnt % 50 == 0) cout << cnt << endl;
+  if (sqlProfile)
+  {
+    cout << endl << profile.report(20);
   }
 
-  return true;
+  Logger::close();
+  return 0;
 }
 
-bool linkByTag(QDir sortDir)
+qint64 currentSequence()
 {
-  QDir linkRoot(sortDir.path() + "/by_tag");
-  if (!linkRoot.exists(sortDir.path() + "/by_tag"))
+  QSqlQuery q(QSqlDatabase::database());
+  if (!q.exec("SELECT max(ChangeLog.Seq) FROM ChangeLog") || !q.next())
   {
-    sortDir.mkdir("by_tag");
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return 0;
   }
+  return q.value(0).toLongLong();
+}
 
+bool upgradeDatabase()
+{
   QSqlQuery q(QSqlDatabase::database());
-  if (!q.exec("SELECT Photos.Name,Photos.date,Tags.Name FROM Photos INNER JOIN Tags ON Photos.Id = Tags.PhotoId"))
+
+  // Photos.Path: the path of the photo in the bulk directory
+  if (!QSqlDatabase::database().record("Photos").contains("Path"))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
-    return false;
+    if (!q.exec("ALTER TABLE Photos ADD COLUMN [Path] VARCHAR(1024) NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Photos").field("sql", q.lastQuery());
   }
-  int cnt = 0;
-  while (q.next())
+
+  // Photos.ObjectId: the photo owning the file of a shared photo
+  if (!QSqlDatabase::database().record("Photos").contains("ObjectId"))
   {
-    QString   name   = q.value(0).toString();
-    QDateTime tstmp  = q.value(1).toDateTime();
-    QString   tag    = q.value(2).toString();
+    if (!q.exec("ALTER TABLE Photos ADD COLUMN [ObjectId] INTEGER NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Photos").field("sql", q.lastQuery());
+  }
 
-    // absolute link directory path
-    QString linkDirPath = QString("%1/%2/%3-%4")
-                          .arg(sortDir.path() + "/by_tag")
-                          .arg(tag)
-                          .arg(tstmp.date().year())
-                          .arg(tstmp.date().month(), 2, 10, QChar('0'));
+  // Views.LinkType: symlink, hard or reflink
+  if (QSqlDatabase::database().tables().contains("Views") &&
+      !QSqlDatabase::database().record("Views").contains("LinkType"))
+  {
+    if (!q.exec("ALTER TABLE Views ADD COLUMN [LinkType] VARCHAR(16) DEFAULT 'symlink' NOT NULL"))
+    {
+      logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+      return false;
+    }
+    logInfo("table upgraded").field("table", "Views").field("sql", q.lastQuery());
+  }
+  return true;
+}
 
-    // absolute link file path
-    QString linkFilePath = QString("%1/%2")
-                           .arg(linkDirPath)
-                           .arg(name);
+qint64 viewWatermark(const QString &view)
+{
+  QSqlQuery q(QSqlDatabase::database());
+  if (!q.prepare("SELECT Views.Watermark FROM Views WHERE Views.Name=?"))
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return -1;
+  }
+  q.bindValue(0, view);
+  if (!q.exec())
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return -1;
+  }
+  return q.next() ? q.value(0).toLongLong() : -1;
+}
 
-    // relative target file path
-    QString targetFilePath = QString("../../../../bulk/%1")
-                             .arg(name);
+QString viewLinkType(const QString &view)
+{
+  QSqlQuery q(QSqlDatabase::database());
+  if (!q.prepare("SELECT Views.LinkType FROM Views WHERE Views.Name=?"))
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return QString();
+  }
+  q.bindValue(0, view);
+  if (!q.exec())
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return QString();
+  }
+  return q.next() ? q.value(0).toString() : QString();
+}
 
-    // if link file exists continue with next item
-    if (QFileInfo(linkFilePath).exists()) continue;
+bool setWatermark(const QString &view, qint64 sequence, const QString &linkType)
+{
+  QSqlQuery q(QSqlDatabase::database());
+  if (!q.prepare("INSERT OR REPLACE INTO Views (Name,Watermark,LinkType) VALUES(?,?,?)"))
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
+  }
+  q.bindValue(0, view);
+  q.bindValue(1, sequence);
+  q.bindValue(2, linkType);
+  if (!q.exec())
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
+  }
+  logInfo("view linked").field("view", view).field("watermark", sequence).field("type", linkType);
+  return true;
+}
 
-    // create the directory and make sure it exists
-    QDir linkDir(linkDirPath); linkDir.mkpath(linkDirPath);
+bool pruneChangeLog()
+{
+  // views which were never linked have no watermark, their first run is a
+  // full one anyway
+  QSqlQuery q(QSqlDatabase::database());
+  if (!q.exec("DELETE FROM ChangeLog WHERE ChangeLog.Seq <= (SELECT min(Views.Watermark) FROM Views)"))
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
+  }
+  return true;
+}
 
-    // create the link
-    QFile::link(targetFilePath, linkFilePath);
-    cnt++; cout << "."; cout.flush(); if (cnt % 50 == 0) cout << cnt << endl;
+bool photoRange(qint64 watermark, qint64 &idFirst, qint64 &idLast)
+{
+  // a negative watermark selects all photos
+  QSqlQuery q(QSqlDatabase::database());
+  if (watermark >= 0)
+  {
+    q.prepare("SELECT min(ChangeLog.PhotoId),max(ChangeLog.PhotoId) FROM ChangeLog WHERE ChangeLog.Seq > ?");
+    q.bindValue(0, watermark);
+  }
+  else
+  {
+    q.prepare("SELECT min(Photos.Id),max(Photos.Id) FROM Photos");
+  }
+  if (!q.exec() || !q.next())
+  {
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
   }
 
+  // an empty range when there are no photos
+  idFirst = q.isNull(0) ? 0  : q.value(0).toLongLong();
+  idLast  = q.isNull(1) ? -1 : q.value(1).toLongLong();
   return true;
 }
 
-bool linkByAlbum(QDir sortDir)
+bool selectPhotos(QSqlQuery &q, QString sql, const LinkTask &task)
 {
-  QDir linkRoot(sortDir.path() + "/by_album");
-  if (!linkRoot.exists(sortDir.path() + "/by_album"))
+  sql += " WHERE Photos.Id BETWEEN ? AND ?";
+  if (task.watermark >= 0)
   {
-    sortDir.mkdir("by_album");
+    sql += " AND Photos.Id IN (SELECT ChangeLog.PhotoId FROM ChangeLog WHERE ChangeLog.Seq > ?)";
   }
 
-  QSqlQuery q(QSqlDatabase::database());
-  if (!q.exec("SELECT Photos.Name,Photos.date,Albums.Name FROM Photos INNER JOIN Albums ON Photos.Id = Albums.PhotoId"))
+  q.setForwardOnly(true);
+  if (!q.prepare(sql))
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
     return false;
   }
-  int cnt = 0;
-  while (q.next())
+  q.bindValue(0, task.idFirst);
+  q.bindValue(1, task.idLast);
+  if (task.watermark >= 0)
+  {
+    q.bindValue(2, task.watermark);
+  }
+  if (!q.exec())
   {
-    QString   name   = q.value(0).toString();
-    QDateTime tstmp  = q.value(1).toDateTime();
-    QString   album  = q.value(2).toString();
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
+  }
+  return true;
+}
 
-    // absolute link directory path
-    QString linkDirPath = QString("%1/%2/%3-%4")
-                          .arg(sortDir.path() + "/by_album")
-                          .arg(album)
-                          .arg(tstmp.date().year())
-                          .arg(tstmp.date().month(), 2, 10, QChar('0'));
+bool LinkWorker::operator()(const LinkTask &task) const
+{
+  // the connection is used by this thread only and removed when done
+  QString connectionName = QString("link-%1").arg(task.idFirst);
+  bool linked = false;
+  {
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(databasePath);
+    db.setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (!db.open())
+    {
+      logError("database cannot be opened").field("error", db.lastError().text()).field("file", databasePath);
+    }
+    else
+    {
+      if (profile)
+      {
+        profile->attach(db);
+      }
+
+      linked = linkPhotos(db, sortDir, task);
+      if (profile)
+      {
+        profile->detach(db);
+      }
+      db.close();
+    }
+  }
+  QSqlDatabase::removeDatabase(connectionName);
 
-    // absolute link file path
-    QString linkFilePath = QString("%1/%2")
-                           .arg(linkDirPath)
-                           .arg(name);
+  {
+    QMutexLocker locker(&outputMutex);
+    cout << ".";
+    cout.flush();
+  }
 
-    // relative target file path
-    QString targetFilePath = QString("../../../../bulk/%1")
-                             .arg(name);
+  logInfo("partition linked").field("views", task.views.join(",")).field("first", task.idFirst).field("last", task.idLast).field("linked", linked);
+  return linked;
+}
 
-    // if link file exists continue with next item
-    if (QFileInfo(linkFilePath).exists()) continue;
+bool linkPhotos(QSqlDatabase db, QDir sortDir, const LinkTask &task)
+{
+  unsigned uses = 0;
+  for (int i = 0; i < task.templates.count(); i++)
+  {
+    uses |= task.templates[i].uses();
+  }
 
-    // create the directory and make sure it exists
-    QDir linkDir(linkDirPath); linkDir.mkpath(linkDirPath);
+  // one row per photo, the tags and albums are aggregated with the unit
+  // separator; the columns no view needs stay NULL. Photos sharing the file
+  // of another photo are linked to the file of that photo
+  QString sql = QString("SELECT Photos.Name,Photos.Date,Photos.Hash,%1,%2,%3,coalesce(Objects.Path,Objects.Name,Photos.Path,Photos.Name) "
+                        "FROM Photos LEFT JOIN Photos AS Objects ON Photos.ObjectId = Objects.Id%4")
+                .arg((uses & ViewTemplate::UsesTags)   ? "(SELECT group_concat(Tags.Name, char(31)) FROM Tags WHERE Tags.PhotoId = Photos.Id)"       : "NULL")
+                .arg((uses & ViewTemplate::UsesAlbums) ? "(SELECT group_concat(Albums.Name, char(31)) FROM Albums WHERE Albums.PhotoId = Photos.Id)" : "NULL")
+                .arg((uses & ViewTemplate::UsesExif)   ? "Exif.PhotoId,Exif.ImageWidth,Exif.ImageHeight,Exif.Make,Exif.Model"                       : "NULL,NULL,NULL,NULL,NULL")
+                .arg((uses & ViewTemplate::UsesExif)   ? " LEFT JOIN Exif ON Photos.Id = Exif.PhotoId"                                                : "");
+
+  // the staging trees of a rebuild are empty, no directory is looked up;
+  // the engines of all running partitions share the descriptor limit
+  int dirCache = LinkEngine::dirBudget(QThreadPool::globalInstance()->maxThreadCount() * task.templates.count());
+  QList<LinkEngine*> engines;
+  for (int i = 0; i < task.templates.count(); i++)
+  {
+    engines << new LinkEngine(sortDir.path() + "/" + viewDirName(task.templates[i].name(), task.rebuild), task.types[i], task.rebuild, dirCache);
+  }
 
-    // create the link
-    QFile::link(targetFilePath, linkFilePath);
-    cnt++; cout << "."; cout.flush(); if (cnt % 50 == 0) cout << cnt << endl;
+  QSqlQuery q(db);
+  if (!selectPhotos(q, sql, task))
+  {
+    qDeleteAll(engines);
+    return false;
   }
 
-  return true;
-}
+  // the buffers are reused for all photos
+  ViewPhoto  photo;
+  QByteArray linkDirPath, targetFilePath;
+  QList<QByteArray> noKey;
+  int links = 0, failed = 0;
+  noKey << QByteArray();
 
-bool linkBySize(QDir sortDir)
-{
-  QDir linkRoot(sortDir.path() + "/by_size");
-  if (!linkRoot.exists(sortDir.path() + "/by_size"))
+  while (q.next())
   {
-    sortDir.mkdir("by_size");
+    QDate date = q.value(1).toDateTime().date();
+    photo.name   = QFile::encodeName(q.value(0).toString());
+    photo.hash   = q.value(2).toString().toLatin1();
+    photo.year   = date.year();
+    photo.month  = date.month();
+    photo.day    = date.day();
+    photo.tags   = q.isNull(3) ? QList<QByteArray>() : QFile::encodeName(q.value(3).toString()).split(31);
+    photo.albums = q.isNull(4) ? QList<QByteArray>() : QFile::encodeName(q.value(4).toString()).split(31);
+    photo.exif   = !q.isNull(5);
+    photo.width  = q.value(6).toInt();
+    photo.height = q.value(7).toInt();
+    photo.make   = QFile::encodeName(q.value(8).toString());
+    photo.model  = QFile::encodeName(q.value(9).toString());
+    photo.path   = QFile::encodeName(q.value(10).toString());
+
+    for (int i = 0; i < task.templates.count(); i++)
+    {
+      const ViewTemplate &view = task.templates[i];
+
+      // views with Exif fields link the photos with Exif data only, views by
+      // tag or album link a photo once per tag or album
+      if ((view.uses() & ViewTemplate::UsesExif) && !photo.exif) continue;
+      const QList<QByteArray> &keys = (view.uses() & ViewTemplate::UsesTags)   ? photo.tags   :
+                                      (view.uses() & ViewTemplate::UsesAlbums) ? photo.albums : noKey;
+
+      view.linkTarget(targetFilePath, photo);
+      for (int k = 0; k < keys.count(); k++)
+      {
+        view.linkDir(linkDirPath, photo, keys[k]);
+        LinkEngine::Result result = engines[i]->link(linkDirPath, photo.name, targetFilePath);
+        if (result == LinkEngine::Linked)
+        {
+          links++;
+        }
+        else if (result == LinkEngine::Failed)
+        {
+          failed++;
+        }
+      }
+    }
   }
 
-  QSqlQuery q(QSqlDatabase::database());
-  if (!q.exec("SELECT Photos.Name,Photos.Date,Exif.ImageWidth,Exif.ImageHeight FROM Photos INNER JOIN Exif ON Photos.Id = Exif.PhotoId"))
+  linkCount.fetchAndAddRelaxed(links);
+
+  // a partition with failed links is not complete, the watermark is kept
+  // and the next run retries the photos (a rebuilt view is not swapped in)
+  qDeleteAll(engines);
+  if (failed > 0)
   {
-    cerr << "ERROR: " << q.lastError().text() << endl;
+    logError("links failed").field("first", task.idFirst).field("last", task.idLast).field("failed", failed);
     return false;
   }
-  int cnt = 0;
-  while (q.next())
+  return true;
+}
+
+bool pruneView(QDir sortDir, const ViewTemplate &view, LinkEngine::Type type)
+{
+  // the expected links in the order of the view tree: the directories of a
+  // path are compared component by component, so '/' is replaced by char(1)
+  // which sorts before any character of a name
+  QSqlQuery q(QSqlDatabase::database());
+  q.setForwardOnly(true);
+  if (!q.exec(view.pathSql()))
   {
-    QString   name   = q.value(0).toString();
-    QDateTime tstmp  = q.value(1).toDateTime();
-    int       width  = q.value(2).toInt();
-    int       height = q.value(3).toInt();
+    logError("query failed").field("error", q.lastError().text()).field("sql", q.lastQuery());
+    return false;
+  }
 
-    // absolute link directory path
-    QString linkDirPath = QString("%1/%2x%3/%4-%5")
-                          .arg(sortDir.path() + "/by_size")
-                          .arg(width)
-                          .arg(height)
-                          .arg(tstmp.date().year())
-                          .arg(tstmp.date().month(), 2, 10, QChar('0'));
+  ViewPrune viewPrune(sortDir.path() + "/by_" + view.name(), type != LinkEngine::Symlink);
+  bool pruned = viewPrune.prune(q);
+  logInfo("view pruned").field("view", view.name()).field("kept", viewPrune.keptLinks()).field("links", viewPrune.removedLinks()).field("dirs", viewPrune.removedDirs()).field("complete", pruned);
+  return pruned;
+}
 
-    // absolute link file path
-    QString linkFilePath = QString("%1/%2")
-                           .arg(linkDirPath)
-                           .arg(name);
+QString viewDirName(const QString &view, bool staging)
+{
+  // the staging tree is hidden and at the same depth as the view, so the
+  // relative link targets are the same
+  return staging ? ".by_" + view + ".new" : "by_" + view;
+}
 
-    // relative target file path
-    QString targetFilePath = QString("../../../../bulk/%1")
-                             .arg(name);
+bool swapView(QDir sortDir, const QString &view, QString &oldViewPath)
+{
+  QString liveViewPath    = sortDir.path() + "/" + viewDirName(view, false);
+  QString stagingViewPath = sortDir.path() + "/" + viewDirName(view, true);
+  QByteArray live    = QFile::encodeName(liveViewPath);
+  QByteArray staging = QFile::encodeName(stagingViewPath);
 
-    // if link file exists continue with next item
-    if (QFileInfo(linkFilePath).exists()) continue;
+  // the old tree takes the place of the staging tree
+  if (syscall(SYS_renameat2, AT_FDCWD, staging.constData(), AT_FDCWD, live.constData(), RENAME_EXCHANGE) == 0)
+  {
+    logInfo("view swapped").field("view", view).field("dir", liveViewPath);
+    oldViewPath = stagingViewPath;
+    return true;
+  }
 
-    // create the directory and make sure it exists
-    QDir linkDir(linkDirPath); linkDir.mkpath(linkDirPath);
+  // the view is built for the first time
+  if (errno == ENOENT && rename(staging.constData(), live.constData()) == 0)
+  {
+    logInfo("view swapped").field("view", view).field("dir", liveViewPath);
+    oldViewPath = QString();
+    return true;
+  }
 
-    // create the link
-    QFile::link(targetFilePath, linkFilePath);
-    cnt++; cout << "."; cout.flush(); if (cnt % 50 == 0) cout << cnt << endl;
+  // file systems without RENAME_EXCHANGE, the view is missing for a moment
+  if (errno == EINVAL || errno == ENOSYS)
+  {
+    oldViewPath = sortDir.path() + "/.by_" + view + ".old";
+    removeView(oldViewPath);
+    if (rename(live.constData(), QFile::encodeName(oldViewPath).constData()) == 0 &&
+        rename(staging.constData(), live.constData()) == 0)
+    {
+      logInfo("view swapped").field("view", view).field("dir", liveViewPath);
+      return true;
+    }
   }
 
+  logError("view cannot be swapped").field("view", view).field("error", strerror(errno));
+  return false;
+}
+
+bool removeView(const QString &viewPath)
+{
+  if (!QFileInfo::exists(viewPath))
+  {
+    return true;
+  }
+  if (!QDir(viewPath).removeRecursively())
+  {
+    logError("directory cannot be removed").field("dir", viewPath);
+    return false;
+  }
+  logInfo("directory removed").field("dir", viewPath);
   return true;
 }
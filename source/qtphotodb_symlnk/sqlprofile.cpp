@@ -0,0 +1,168 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "sqlprofile.h"
+
+#include <algorithm>
+
+#include <sqlite3.h>
+
+struct SqlStat
+{
+  QByteArray sql;
+  quint64 count, rows;
+  quint64 totalTime, maxTime;
+  quint64 fullScan, sort, autoIndex, vmStep;
+};
+
+SqlProfile::SqlProfile()
+{
+}
+
+SqlProfile::~SqlProfile()
+{
+  // the connections must not call back into a deleted profile
+  for (int i = 0; i < connectionList.count(); i++)
+  {
+    sqlite3_trace_v2(connectionList[i], 0, 0, 0);
+  }
+  qDeleteAll(statList);
+}
+
+bool SqlProfile::attach(const QSqlDatabase &db)
+{
+  // the statements are profiled by sqlite itself each time they are reset
+  // or finalized
+  sqlite3 *conn = connection(db);
+  if (!conn || sqlite3_trace_v2(conn, SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW, trace, this) != SQLITE_OK)
+  {
+    return false;
+  }
+
+  QMutexLocker locker(&mutex);
+  connectionList.append(conn);
+  return true;
+}
+
+void SqlProfile::detach(const QSqlDatabase &db)
+{
+  sqlite3 *conn = connection(db);
+  QMutexLocker locker(&mutex);
+  if (conn && connectionList.removeAll(conn) > 0)
+  {
+    sqlite3_trace_v2(conn, 0, 0, 0);
+  }
+}
+
+sqlite3 *SqlProfile::connection(const QSqlDatabase &db)
+{
+  // the QSQLITE driver exposes the sqlite3 connection handle
+  // note: the driver and this tool must use the same sqlite library
+  QVariant handle = db.driver()->handle();
+  if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0)
+  {
+    return 0;
+  }
+  return *static_cast<sqlite3 **>(handle.data());
+}
+
+int SqlProfile::trace(unsigned type, void *context, void *p, void *x)
+{
+  SqlProfile *profile = static_cast<SqlProfile*>(context);
+  sqlite3_stmt *stmt = static_cast<sqlite3_stmt*>(p);
+  QMutexLocker locker(&profile->mutex);
+
+  // count the rows until the statement is finished
+  if (type == SQLITE_TRACE_ROW)
+  {
+    profile->rowList[stmt]++;
+    return 0;
+  }
+
+  if (type != SQLITE_TRACE_PROFILE)
+  {
+    return 0;
+  }
+
+  // statistics are collected per distinct sql text (with unbound parameters)
+  QByteArray sql(sqlite3_sql(stmt));
+  SqlStat *stat = profile->statList.value(sql);
+  if (!stat)
+  {
+    stat = new SqlStat();
+    stat->sql = sql;
+    stat->count = stat->rows = 0;
+    stat->totalTime = stat->maxTime = 0;
+    stat->fullScan = stat->sort = stat->autoIndex = stat->vmStep = 0;
+    profile->statList.insert(sql, stat);
+  }
+
+  quint64 time = *static_cast<sqlite3_int64*>(x);
+  stat->count++;
+  stat->rows      += profile->rowList.take(stmt);
+  stat->totalTime += time;
+  stat->maxTime    = qMax(stat->maxTime, time);
+  stat->fullScan  += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+  stat->sort      += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT,          1);
+  stat->autoIndex += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX,     1);
+  stat->vmStep    += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP,       1);
+
+  return 0;
+}
+
+static bool totalTimeGreaterThan(const SqlStat *s1, const SqlStat *s2)
+{
+  return s1->totalTime > s2->totalTime;
+}
+
+QString SqlProfile::report(int count)
+{
+  QMutexLocker locker(&mutex);
+  QString reportString;
+  QTextStream out(&reportString);
+
+  QList<SqlStat*> stats = statList.values();
+  std::sort(stats.begin(), stats.end(), totalTimeGreaterThan);
+
+  out << "SQL profile (top " << qMin(count, stats.count()) << " of " << stats.count() << " statements by total time):" << endl;
+  out << QString("%1 %2 %3 %4 %5 %6 %7 %8  %9")
+         .arg("count",     10).arg("total ms", 10).arg("max ms", 8).arg("rows", 10)
+         .arg("fullscan",  10).arg("sort",      6).arg("autoidx", 7).arg("vmstep", 12)
+         .arg("sql") << endl;
+
+  for (int i = 0; i < stats.count() && i < count; i++)
+  {
+    SqlStat *stat = stats[i];
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8  %9")
+           .arg(stat->count,                         10)
+           .arg(stat->totalTime / 1000000.0,         10, 'f', 1)
+           .arg(stat->maxTime   / 1000000.0,          8, 'f', 2)
+           .arg(stat->rows,                          10)
+           .arg(stat->fullScan,                      10)
+           .arg(stat->sort,                           6)
+           .arg(stat->autoIndex,                      7)
+           .arg(stat->vmStep,                        12)
+           .arg(QString::fromUtf8(stat->sql).simplified()) << endl;
+  }
+
+  return reportString;
+}
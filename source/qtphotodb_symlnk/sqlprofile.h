@@ -0,0 +1,50 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef SQLPROFILE_H
+#define SQLPROFILE_H
+
+struct SqlStat;
+struct sqlite3;
+class SqlProfile
+{
+  public:
+    SqlProfile();
+    virtual ~SqlProfile();
+
+    // the connections are detached by the destructor, a connection which
+    // is closed before has to be detached first
+    bool attach(const QSqlDatabase &db);
+    void detach(const QSqlDatabase &db);
+    QString report(int count);
+
+  private:
+    static int trace(unsigned type, void *context, void *p, void *x);
+    static sqlite3 *connection(const QSqlDatabase &db);
+
+  private:
+    QHash<QByteArray, SqlStat*> statList;
+    QHash<void*, quint64> rowList;
+    QList<sqlite3*> connectionList;
+    QMutex mutex;
+};
+
+#endif // SQLPROFILE_H
@@ -21,3 +21,4 @@
 
 #include <QtCore>
 #include <QtSql>
+#include <QtConcurrent>
@@ -0,0 +1,165 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "viewprune.h"
+#include "logger.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct PruneEntry
+{
+  QByteArray name;
+  bool       isDir;
+  bool       isLink;
+
+  bool operator<(const PruneEntry &other) const { return name < other.name; }
+};
+
+ViewPrune::ViewPrune(const QString &viewPath, bool regularFiles)
+  : viewPath(QFile::encodeName(viewPath)), regularFiles(regularFiles), expected(0), atEnd(true), failed(false), kept(0), removed(0), dirs(0)
+{
+}
+
+bool ViewPrune::prune(QSqlQuery &expected)
+{
+  this->expected = &expected;
+  atEnd = !expected.next();
+  current = atEnd ? QByteArray() : QFile::encodeName(expected.value(0).toString());
+
+  DIR *dir = opendir(viewPath.constData());
+  if (!dir)
+  {
+    logError("directory cannot be read").field("dir", QFile::decodeName(viewPath)).field("error", strerror(errno));
+    return false;
+  }
+  failed = false;
+  walk(dir, QByteArray());
+  closedir(dir);
+  return !failed;
+}
+
+qint64 ViewPrune::walk(DIR *dir, const QByteArray &prefix)
+{
+  // the entries of this directory, in the order of the expected paths
+  // errno tells the end of the directory from a read error
+  QList<PruneEntry> entries;
+  struct dirent *ent;
+  while ((errno = 0, ent = readdir(dir)) != 0)
+  {
+    if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+    {
+      continue;
+    }
+
+    PruneEntry entry;
+    entry.name   = QByteArray(ent->d_name);
+    entry.isDir  = (ent->d_type == DT_DIR);
+    entry.isLink = (ent->d_type == (regularFiles ? DT_REG : DT_LNK));
+    if (ent->d_type == DT_UNKNOWN)
+    {
+      struct stat st;
+      if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+      {
+        entry.isDir  = S_ISDIR(st.st_mode);
+        entry.isLink = regularFiles ? S_ISREG(st.st_mode) : S_ISLNK(st.st_mode);
+      }
+    }
+    entries << entry;
+  }
+  if (errno != 0)
+  {
+    // the entries not read are kept, the directory is not empty
+    logError("directory cannot be read").field("dir", QFile::decodeName(QByteArray(prefix).replace('\1', '/'))).field("error", strerror(errno));
+    failed = true;
+    return 1;
+  }
+  std::sort(entries.begin(), entries.end());
+
+  qint64 left = 0;
+  for (int i = 0; i < entries.count(); i++)
+  {
+    const PruneEntry &entry = entries[i];
+    QByteArray path = prefix + entry.name;
+
+    if (entry.isDir)
+    {
+      int childFd = openat(dirfd(dir), entry.name.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      DIR *child  = (childFd < 0) ? 0 : fdopendir(childFd);
+      if (!child)
+      {
+        logError("directory cannot be read").field("dir", QFile::decodeName(QByteArray(path).replace('\1', '/'))).field("error", strerror(errno));
+        if (childFd >= 0) close(childFd);
+        failed = true;
+        left++;
+        continue;
+      }
+      qint64 childLeft = walk(child, path + '\1');
+      closedir(child);
+
+      if (childLeft == 0 && unlinkat(dirfd(dir), entry.name.constData(), AT_REMOVEDIR) == 0)
+      {
+        dirs++;
+      }
+      else
+      {
+        left++;
+      }
+    }
+    else if (entry.isLink)
+    {
+      // expected links which are missing are created by the link run
+      while (!atEnd && current < path)
+      {
+        atEnd = !expected->next();
+        current = atEnd ? QByteArray() : QFile::encodeName(expected->value(0).toString());
+      }
+
+      if (!atEnd && current == path)
+      {
+        kept++;
+        left++;
+      }
+      else if (unlinkat(dirfd(dir), entry.name.constData(), 0) == 0)
+      {
+        removed++;
+      }
+      else
+      {
+        logError("link cannot be removed").field("file", QFile::decodeName(QByteArray(path).replace('\1', '/'))).field("error", strerror(errno));
+        failed = true;
+        left++;
+      }
+    }
+    else
+    {
+      // files which are not links were not created by the link run
+      left++;
+    }
+  }
+  return left;
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef VIEWPRUNE_H
+#define VIEWPRUNE_H
+
+#include <dirent.h>
+
+// Removes the links of a view which are not in the catalog anymore, and the
+// directories left empty. The view tree is walked one directory at a time
+// with its entries in byte order, and merged with the expected links which
+// come from the database in the same order, so only one directory is held
+// in memory. Views of hard links or reflinks hold regular files instead of
+// symbolic links.
+class ViewPrune
+{
+  public:
+    ViewPrune(const QString &viewPath, bool regularFiles = false);
+
+    // 'expected' is an executed query returning the path of each expected
+    // link relative to the view directory, with '/' replaced by char(1),
+    // ordered by this path; false if a part of the tree could not be read
+    // or a stale link not removed (the rest is pruned anyway)
+    bool prune(QSqlQuery &expected);
+
+    qint64 keptLinks()    const { return kept;    }
+    qint64 removedLinks() const { return removed; }
+    qint64 removedDirs()  const { return dirs;    }
+
+  private:
+    qint64 walk(DIR *dir, const QByteArray &prefix);
+
+  private:
+    QByteArray viewPath;
+    bool       regularFiles;
+    QSqlQuery *expected;
+    QByteArray current;
+    bool       atEnd;
+    bool       failed;
+    qint64     kept, removed, dirs;
+};
+
+#endif // VIEWPRUNE_H
@@ -0,0 +1,253 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#include "stable.h"
+#include "viewtemplate.h"
+
+// a value which cannot be a directory name (empty, '.' or '..') is stored in
+// this directory, '/' in values is replaced by '_'
+#define VIEW_EMPTY_VALUE "_"
+
+static void appendValue(QByteArray &dir, const QByteArray &value)
+{
+  int first = 0, last = value.size();
+  while (first < last && value[first]    == ' ') first++;
+  while (last > first && value[last - 1] == ' ') last--;
+
+  if (last == first || (last - first <= 2 && value.mid(first, last - first).count('.') == last - first))
+  {
+    dir += VIEW_EMPTY_VALUE;
+    return;
+  }
+
+  int start = dir.size();
+  dir.append(value.constData() + first, last - first);
+  for (int i = start; i < dir.size(); i++)
+  {
+    if (dir[i] == '/') dir[i] = '_';
+  }
+}
+
+static void appendNumber(QByteArray &dir, int value, int width)
+{
+  char digits[16];
+  int  count = 0;
+  unsigned v = value < 0 ? 0 : value;
+  do
+  {
+    digits[count++] = '0' + v % 10;
+    v /= 10;
+  } while (v && count < 16);
+  while (count < width && count < 16)
+  {
+    digits[count++] = '0';
+  }
+  while (count)
+  {
+    dir += digits[--count];
+  }
+}
+
+static QString valueSql(const QString &column)
+{
+  // same rules as appendValue()
+  return QString("(CASE WHEN trim(ifnull(%1, ''), ' ') IN ('', '.', '..') THEN '%2' ELSE replace(trim(%1, ' '), '/', '_') END)")
+         .arg(column)
+         .arg(VIEW_EMPTY_VALUE);
+}
+
+ViewTemplate::ViewTemplate()
+  : useList(0)
+{
+}
+
+bool ViewTemplate::parse(const QString &spec)
+{
+  viewName    = spec.section('=', 0, 0).trimmed();
+  viewPattern = spec.section('=', 1).trimmed();
+  if (viewName.startsWith("by_"))
+  {
+    viewName.remove(0, 3);
+  }
+
+  if (viewPattern.isEmpty())
+  {
+    if      (viewName == "date")  viewPattern = "{yyyy}/{mm}/{dd}";
+    else if (viewName == "tag")   viewPattern = "{tag}/{yyyy}-{mm}";
+    else if (viewName == "album") viewPattern = "{album}/{yyyy}-{mm}";
+    else if (viewName == "size")  viewPattern = "{width}x{height}/{yyyy}-{mm}";
+    else return false;
+  }
+  if (viewName.isEmpty() || viewName.contains('/') || viewName.contains(QChar(' ')))
+  {
+    return false;
+  }
+
+  // every directory of the template needs a name
+  QStringList dirs = viewPattern.split('/');
+  for (int i = 0; i < dirs.count(); i++)
+  {
+    if (dirs[i].isEmpty() || dirs[i] == "." || dirs[i] == "..")
+    {
+      return false;
+    }
+  }
+
+  segments.clear();
+  useList = 0;
+  for (int pos = 0; pos < viewPattern.length(); )
+  {
+    Segment segment;
+    segment.field = Literal;
+    segment.width = 0;
+
+    if (viewPattern[pos] != '{')
+    {
+      int end = viewPattern.indexOf('{', pos);
+      if (end < 0) end = viewPattern.length();
+      segment.text = QFile::encodeName(viewPattern.mid(pos, end - pos));
+      if (segment.text.contains('}'))
+      {
+        return false;
+      }
+      segments << segment;
+      pos = end;
+      continue;
+    }
+
+    int end = viewPattern.indexOf('}', pos);
+    if (end < 0)
+    {
+      return false;
+    }
+    QString field = viewPattern.mid(pos + 1, end - pos - 1);
+    pos = end + 1;
+
+    if      (field == "yyyy")   segment.field = Year;
+    else if (field == "mm")     segment.field = Month;
+    else if (field == "dd")     segment.field = Day;
+    else if (field == "tag")    { segment.field = Tag;    useList |= UsesTags;   }
+    else if (field == "album")  { segment.field = Album;  useList |= UsesAlbums; }
+    else if (field == "width")  { segment.field = Width;  useList |= UsesExif;   }
+    else if (field == "height") { segment.field = Height; useList |= UsesExif;   }
+    else if (field == "make")   { segment.field = Make;   useList |= UsesExif;   }
+    else if (field == "model")  { segment.field = Model;  useList |= UsesExif;   }
+    else if (field == "hash" || field.startsWith("hash:"))
+    {
+      bool ok = true;
+      segment.field = Hash;
+      segment.width = (field == "hash") ? 2 : field.mid(5).toInt(&ok);
+      if (!ok || segment.width < 1 || segment.width > 32)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      return false;
+    }
+    segments << segment;
+  }
+
+  // a link belongs to one tag or one album
+  if ((useList & UsesTags) && (useList & UsesAlbums))
+  {
+    return false;
+  }
+
+  // from <root>/sort/by_<name>/<dirs>/ back to <root>/bulk/
+  targetPrefix.clear();
+  for (int i = 0; i < dirs.count() + 2; i++)
+  {
+    targetPrefix += "../";
+  }
+  targetPrefix += "bulk/";
+  return true;
+}
+
+void ViewTemplate::linkDir(QByteArray &dir, const ViewPhoto &photo, const QByteArray &key) const
+{
+  dir.resize(0);
+  for (int i = 0; i < segments.count(); i++)
+  {
+    const Segment &segment = segments[i];
+    switch (segment.field)
+    {
+      case Literal: dir += segment.text;                  break;
+      case Year:    appendNumber(dir, photo.year,   4);   break;
+      case Month:   appendNumber(dir, photo.month,  2);   break;
+      case Day:     appendNumber(dir, photo.day,    2);   break;
+      case Tag:     appendValue (dir, key);               break;
+      case Album:   appendValue (dir, key);               break;
+      case Width:   appendNumber(dir, photo.width,  0);   break;
+      case Height:  appendNumber(dir, photo.height, 0);   break;
+      case Make:    appendValue (dir, photo.make);        break;
+      case Model:   appendValue (dir, photo.model);       break;
+      case Hash:    appendValue (dir, photo.hash.left(segment.width)); break;
+    }
+  }
+}
+
+void ViewTemplate::linkTarget(QByteArray &target, const ViewPhoto &photo) const
+{
+  target.resize(0);
+  target += targetPrefix;
+  target += photo.path;
+}
+
+QString ViewTemplate::pathSql() const
+{
+  QStringList parts;
+  for (int i = 0; i < segments.count(); i++)
+  {
+    const Segment &segment = segments[i];
+    switch (segment.field)
+    {
+      case Literal: parts << "'" + QFile::decodeName(segment.text).replace("'", "''") + "'"; break;
+      case Year:    parts << "strftime('%Y', Photos.Date)";                                   break;
+      case Month:   parts << "strftime('%m', Photos.Date)";                                   break;
+      case Day:     parts << "strftime('%d', Photos.Date)";                                   break;
+      case Tag:     parts << valueSql("Tags.Name");                                           break;
+      case Album:   parts << valueSql("Albums.Name");                                         break;
+      case Width:   parts << "ifnull(Exif.ImageWidth, 0)";                                    break;
+      case Height:  parts << "ifnull(Exif.ImageHeight, 0)";                                   break;
+      case Make:    parts << valueSql("Exif.Make");                                           break;
+      case Model:   parts << valueSql("Exif.Model");                                          break;
+      case Hash:    parts << valueSql(QString("substr(Photos.Hash, 1, %1)").arg(segment.width)); break;
+    }
+  }
+
+  QString sql = QString("SELECT replace(%1 || '/' || Photos.Name, '/', char(1)) AS Path FROM Photos")
+                .arg(parts.join(" || "));
+  if (useList & UsesTags)
+  {
+    sql += " INNER JOIN Tags ON Photos.Id = Tags.PhotoId";
+  }
+  if (useList & UsesAlbums)
+  {
+    sql += " INNER JOIN Albums ON Photos.Id = Albums.PhotoId";
+  }
+  if (useList & UsesExif)
+  {
+    sql += " INNER JOIN Exif ON Photos.Id = Exif.PhotoId";
+  }
+  return sql + " ORDER BY Path";
+}
@@ -0,0 +1,90 @@
+/****************************************************************************
+**
+** Copyright (C) 2010-2015 B.D. Mihai.
+**
+** This file is part of qtphotodb.
+**
+** qtphotodb  is  free  software:  you  can redistribute it and/or modify it
+** under the terms of the GNU Lesser Public License as published by the Free
+** Software Foundation, either version 3 of the License, or (at your option)
+** any later version.
+**
+** qtphotodb  is  distributed  in  the  hope  that  it  will be  useful,  but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser Public License for
+** more details.
+**
+** You should have received a copy of the GNU Lesser Public License along
+** with qtphotodb.  If not, see http://www.gnu.org/licenses/.
+**
+****************************************************************************/
+
+#ifndef VIEWTEMPLATE_H
+#define VIEWTEMPLATE_H
+
+// One photo of the catalog scan, the text values are encoded as file names
+struct ViewPhoto
+{
+  QByteArray name;
+  QByteArray path;   // relative to bulk/
+  QByteArray hash;
+  int        year, month, day;
+  QList<QByteArray> tags;
+  QList<QByteArray> albums;
+  bool       exif;
+  int        width, height;
+  QByteArray make, model;
+};
+
+// A view given by a template of its directories, e.g. the builtin views
+//   date  = {yyyy}/{mm}/{dd}
+//   tag   = {tag}/{yyyy}-{mm}
+//   album = {album}/{yyyy}-{mm}
+//   size  = {width}x{height}/{yyyy}-{mm}
+// or user defined ones like camera={make}/{model}/{yyyy}. {hash:N} fans a
+// directory out by the first N hex digits of the photo hash. The template
+// is parsed once, the directory of a photo is then appended field by field
+// into a reused buffer.
+class ViewTemplate
+{
+  public:
+    enum Uses { UsesTags = 1, UsesAlbums = 2, UsesExif = 4 };
+
+    ViewTemplate();
+
+    // 'spec' is the name of a builtin view or name=template
+    bool parse(const QString &spec);
+
+    QString  name()    const { return viewName; }
+    QString  pattern() const { return viewPattern; }
+    unsigned uses()    const { return useList; }
+
+    // directory of the link relative to the view directory, 'key' is the
+    // tag or the album for views by tag or album
+    void linkDir(QByteArray &dir, const ViewPhoto &photo, const QByteArray &key) const;
+
+    // relative link target, the depth is given by the template
+    void linkTarget(QByteArray &target, const ViewPhoto &photo) const;
+
+    // query of all link paths of the view, relative to the view directory,
+    // with '/' replaced by char(1) and in this order (see ViewPrune)
+    QString pathSql() const;
+
+  private:
+    enum Field { Literal, Year, Month, Day, Tag, Album, Width, Height, Make, Model, Hash };
+    struct Segment
+    {
+      Field      field;
+      QByteArray text;   // literal text
+      int        width;  // digits of {hash:N}
+    };
+
+  private:
+    QString    viewName;
+    QString    viewPattern;
+    unsigned   useList;
+    QByteArray targetPrefix;
+    QVector<Segment> segments;
+};
+
+#endif // VIEWTEMPLATE_H